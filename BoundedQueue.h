@@ -0,0 +1,67 @@
+#ifndef BOUNDEDQUEUE_INCLUDED
+#define BOUNDEDQUEUE_INCLUDED
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <cstddef>
+
+// A fixed-capacity queue from one producer thread to one consumer thread, without locks:
+// a ring of capacity + 1 slots with the producer owning the tail and the consumer the
+// head. push waits while the queue is full, which is what holds a fast producer back to
+// the consumer's pace; pop waits while it is empty. Waiting spins briefly, then sleeps in
+// short steps, since either side may be held up for a whole batch of work.
+//
+// The producer calls close() after its last push; pop then returns false once the queue
+// has drained.
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+     : m_slots(capacity + 1), m_head(0), m_tail(0), m_closed(false)
+    {}
+    void push(T item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % m_slots.size();
+        for (int tries = 0; next == m_head.load(std::memory_order_acquire); tries++)
+            wait(tries);
+        m_slots[tail] = std::move(item);
+        m_tail.store(next, std::memory_order_release);
+    }
+    bool pop(T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        for (int tries = 0; head == m_tail.load(std::memory_order_acquire); tries++) {
+                // everything pushed before close() is visible once the close is
+            if (m_closed.load(std::memory_order_acquire) && head == m_tail.load(std::memory_order_acquire))
+                return false;
+            wait(tries);
+        }
+        item = std::move(m_slots[head]);
+        m_slots[head] = T();                        // let go of what the item held now, not a lap later
+        m_head.store((head + 1) % m_slots.size(), std::memory_order_release);
+        return true;
+    }
+    void close() {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+      // C++11 syntax for preventing copying and assignment
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+private:
+    std::vector<T> m_slots;
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+    std::atomic<bool> m_closed;
+
+    static void wait(int tries) {
+        if (tries < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+};
+
+#endif // BOUNDEDQUEUE_INCLUDED
@@ -0,0 +1,130 @@
+#ifndef EPOCH_INCLUDED
+#define EPOCH_INCLUDED
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+// Epoch-based reclamation: lets readers follow a pointer that a writer may swap out at
+// any moment, without either side taking a lock.
+//
+// A reader holds a Guard while it uses what it loaded. The Guard publishes the global
+// epoch in the thread's slot before the reader loads anything, and clears it after.
+// A writer that has swapped an object out retires it: the object is tagged with the
+// epoch of the swap (bumping the epoch), and deleted once every pinned slot is newer
+// than that tag. Any reader that could have loaded the old pointer pinned no later
+// than the swap, so it holds the deletion back until it lets go.
+//
+// Slots are per thread and shared by every user in the process; a finished thread's
+// slot is handed to the next thread that needs one.
+
+namespace Epoch
+{
+    const uint64_t IDLE = UINT64_MAX;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> epoch{ IDLE };
+        std::atomic<bool> used{ false };
+        Slot* next = nullptr;
+        int depth = 0;                      // nested Guards on the owning thread
+    };
+
+    inline std::atomic<uint64_t> globalEpoch{ 0 };
+    inline std::atomic<Slot*> slots{ nullptr };     // every slot ever made; the list only grows
+
+    inline Slot* acquireSlot() {
+        for (Slot* s = slots.load(); s != nullptr; s = s->next) {
+            bool free = false;
+            if (!s->used.load() && s->used.compare_exchange_strong(free, true))
+                return s;
+        }
+        Slot* s = new Slot;
+        s->used = true;
+        s->next = slots.load();
+        while (!slots.compare_exchange_weak(s->next, s))
+            ;
+        return s;
+    }
+
+    struct ThreadSlot
+    {
+        Slot* slot = acquireSlot();
+        ~ThreadSlot() { slot->used.store(false); }
+    };
+
+    inline Slot& threadSlot() {
+        thread_local ThreadSlot mine;
+        return *mine.slot;
+    }
+
+        // pins the calling thread for its lifetime; Guards nest
+    class Guard
+    {
+    public:
+        Guard() : m_slot(threadSlot()) {
+            if (m_slot.depth++ == 0)
+                m_slot.epoch.store(globalEpoch.load());
+        }
+        ~Guard() {
+            if (--m_slot.depth == 0)
+                m_slot.epoch.store(IDLE);
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    private:
+        Slot& m_slot;
+    };
+
+        // the oldest epoch a reader is pinned at, IDLE if none is
+    inline uint64_t oldestPinned() {
+        uint64_t oldest = IDLE;
+        for (Slot* s = slots.load(); s != nullptr; s = s->next) {
+            uint64_t e = s->epoch.load();
+            if (e < oldest)
+                oldest = e;
+        }
+        return oldest;
+    }
+
+        // A writer's objects waiting for their readers to finish. Not thread-safe: one
+        // writer at a time (or the writer's own lock) owns it. Destroying it deletes
+        // whatever is left, so no reader may still be running then.
+    class Retired
+    {
+    public:
+        ~Retired() {
+            for (size_t i = 0; i < m_items.size(); i++)
+                m_items[i].destroy(m_items[i].object);
+        }
+            // call after the last pointer readers could load p from has been replaced
+        template<typename T>
+        void retire(const T* p) {
+            m_items.push_back({ globalEpoch.fetch_add(1), p, [](const void* q) { delete static_cast<const T*>(q); } });
+            reclaim();
+        }
+            // deletes every retired object no reader can still hold
+        void reclaim() {
+            uint64_t oldest = oldestPinned();
+            size_t kept = 0;
+            for (size_t i = 0; i < m_items.size(); i++) {
+                if (m_items[i].epoch < oldest)
+                    m_items[i].destroy(m_items[i].object);
+                else
+                    m_items[kept++] = m_items[i];
+            }
+            m_items.resize(kept);
+        }
+        size_t pending() const { return m_items.size(); }
+    private:
+        struct Item
+        {
+            uint64_t epoch;
+            const void* object;
+            void (*destroy)(const void*);
+        };
+        std::vector<Item> m_items;
+    };
+}
+
+#endif // EPOCH_INCLUDED
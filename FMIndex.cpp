@@ -0,0 +1,226 @@
+#include "FMIndex.h"
+#include "RadixSort.h"
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+using namespace std;
+
+FMIndex::FMIndex()
+{
+    m_size = 0;
+    fill(m_before, m_before + SYMBOLS, 0);
+    m_blockData = nullptr;
+    m_blockCount = 0;
+    m_sampleData = nullptr;
+    m_sampleCount = 0;
+}
+
+size_t FMIndex::bytes() const
+{
+    return m_blockCount * sizeof(Block) + m_sampleCount * sizeof(uint32_t);
+}
+
+void FMIndex::build(const vector<unsigned char>& text, int workers)
+{
+    // Suffix array by prefix doubling (Larsson-Sadakane): sort every suffix by its first
+    // 21 symbols (3 bits each), then, while some suffixes still tie, sort each tied group
+    // by the rank of the suffix h further on and double h. Only the tied groups are
+    // sorted again, all of them in one radix sort of (group, key, position) records. A
+    // suffix's rank is one past the end of its group's range, so ranks already handed out
+    // stay ordered as groups split.
+
+    const int SYMBOLS_PER_WORD = 21;
+    uint32_t n = static_cast<uint32_t>(text.size());
+    m_size = n;
+    m_blocks.clear();
+    m_samples.clear();
+    m_blockData = nullptr;
+    m_blockCount = 0;
+    m_sampleData = nullptr;
+    m_sampleCount = 0;
+    fill(m_before, m_before + SYMBOLS, 0);
+    if (n == 0)
+        return;
+
+    vector<uint64_t> records(size_t(n) * 2);
+    uint64_t key = 0;
+    for (uint32_t i = 0; i < SYMBOLS_PER_WORD - 1; i++)
+        key = (key << 3) | (i < n ? text[i] : 0);
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t next = i + SYMBOLS_PER_WORD - 1;
+        key = ((key << 3) | (next < n ? text[next] : 0)) & ((uint64_t(1) << (3 * SYMBOLS_PER_WORD)) - 1);
+        records[2 * size_t(i)] = key;
+        records[2 * size_t(i) + 1] = i;
+    }
+    radixSortRecords(records, 2, 1, workers);
+
+        // ranks are at least 1, so "past the end" (0) sorts first
+    vector<uint32_t> sa(n), rank(n);
+    vector<pair<uint32_t, uint32_t>> tied;      // SA ranges whose suffixes are still equal
+    auto split = [&](uint32_t begin, uint32_t end, const uint64_t* sorted, vector<pair<uint32_t, uint32_t>>& stillTied) {
+        // sa[begin, end) is in order; give each run of equal keys its rank
+        for (uint32_t run = begin; run < end; ) {
+            uint32_t last = run + 1;
+            while (last < end && sorted[2 * size_t(last - begin)] == sorted[2 * size_t(run - begin)])
+                last++;
+            for (uint32_t t = run; t < last; t++)
+                rank[sa[t]] = last;
+            if (last - run > 1)
+                stillTied.push_back(make_pair(run, last));
+            run = last;
+        }
+    };
+    for (uint32_t j = 0; j < n; j++)
+        sa[j] = uint32_t(records[2 * size_t(j) + 1]);
+    split(0, n, records.data(), tied);
+
+    for (uint32_t h = SYMBOLS_PER_WORD; !tied.empty(); h = (h > n / 2) ? n : 2 * h) {
+        size_t count = 0;
+        for (size_t g = 0; g < tied.size(); g++)
+            count += tied[g].second - tied[g].first;
+        records.resize(count * 2);
+        size_t r = 0;
+        for (size_t g = 0; g < tied.size(); g++)
+            for (uint32_t t = tied[g].first; t < tied[g].second; t++, r++) {
+                uint32_t i = sa[t];
+                records[2 * r] = uint64_t(tied[g].first) << 32 | (i + h < n ? rank[i + h] : 0);
+                records[2 * r + 1] = i;
+            }
+        radixSortRecords(records, 2, 1, workers);
+
+            // the groups come back in the order they were listed, each sorted within itself
+        vector<pair<uint32_t, uint32_t>> stillTied;
+        r = 0;
+        for (size_t g = 0; g < tied.size(); g++) {
+            const uint64_t* sorted = &records[2 * r];
+            for (uint32_t t = tied[g].first; t < tied[g].second; t++, r++)
+                sa[t] = uint32_t(records[2 * r + 1]);
+            split(tied[g].first, tied[g].second, sorted, stillTied);
+        }
+        tied.swap(stillTied);
+    }
+    vector<uint32_t>().swap(rank);
+    vector<uint64_t>().swap(records);
+
+        // the BWT row j holds the symbol before suffix SA[j]; count it into the blocks as we go
+    uint32_t counts[SYMBOLS] = {};
+    m_blocks.assign(n / 64 + 1, Block());
+    for (uint32_t j = 0; j < n; j++) {
+        uint32_t position = sa[j];
+        int symbol = text[position == 0 ? n - 1 : position - 1];
+        Block& b = m_blocks[j / 64];
+        if (j % 64 == 0) {
+            copy(counts + 1, counts + SYMBOLS, b.counts);
+            b.samplesBefore = static_cast<uint32_t>(m_samples.size());
+            b.planes[0] = b.planes[1] = b.planes[2] = 0;
+            b.sampled = 0;
+        }
+        for (int plane = 0; plane < 3; plane++)
+            b.planes[plane] |= uint64_t((symbol >> plane) & 1) << (j % 64);
+        if (position % SAMPLE_RATE == 0 || symbol == SEPARATOR) {
+            b.sampled |= uint64_t(1) << (j % 64);
+            m_samples.push_back(position);
+        }
+        counts[symbol]++;
+    }
+    if (n % 64 == 0) {
+        Block& b = m_blocks.back();
+        copy(counts + 1, counts + SYMBOLS, b.counts);
+        b.samplesBefore = static_cast<uint32_t>(m_samples.size());
+        b.planes[0] = b.planes[1] = b.planes[2] = 0;
+        b.sampled = 0;
+    }
+
+    uint32_t total = 0;
+    for (int c = 0; c < SYMBOLS; c++) {
+        m_before[c] = total;
+        total += counts[c];
+    }
+    m_blockData = m_blocks.data();
+    m_blockCount = m_blocks.size();
+    m_sampleData = m_samples.data();
+    m_sampleCount = m_samples.size();
+}
+
+bool FMIndex::attach(size_t size, const uint32_t* before, const void* blocks, size_t blockCount,
+                     const uint32_t* samples, size_t sampleCount, bool verify)
+{
+    if (size > UINT32_MAX || blockCount != (size == 0 ? 0 : size / 64 + 1) || before[0] != 0)
+        return false;
+    for (int c = 1; c < SYMBOLS; c++)
+        if (before[c] < before[c - 1] || before[c] > size)
+            return false;
+    const Block* block = static_cast<const Block*>(blocks);
+    if (blockCount > 0 && block[blockCount - 1].samplesBefore + size_t(__builtin_popcountll(block[blockCount - 1].sampled)) != sampleCount)
+        return false;
+
+    uint32_t counts[SYMBOLS] = {};
+    size_t sampled = 0;
+    for (size_t k = 0; verify && k < blockCount; k++) {
+        const Block& b = block[k];
+        if (!equal(counts + 1, counts + SYMBOLS, b.counts) || b.samplesBefore != sampled)
+            return false;
+        size_t rows = min<size_t>(64, size - k * 64);
+        uint64_t inside = rows == 64 ? ~uint64_t(0) : (uint64_t(1) << rows) - 1;
+        uint64_t any = b.planes[0] | b.planes[1] | b.planes[2] | b.sampled;
+        if ((any & ~inside) != 0 || (b.planes[1] & b.planes[2]) != 0)
+            return false;           // bits past the text, or symbols 6 and 7
+        for (int c = 0; c < SYMBOLS; c++) {
+            uint64_t match = (c & 1 ? b.planes[0] : ~b.planes[0]) &
+                             (c & 2 ? b.planes[1] : ~b.planes[1]) &
+                             (c & 4 ? b.planes[2] : ~b.planes[2]) & inside;
+            if (c == SEPARATOR && (match & ~b.sampled) != 0)
+                return false;
+            counts[c] += static_cast<uint32_t>(__builtin_popcountll(match));
+        }
+        sampled += __builtin_popcountll(b.sampled);
+    }
+    if (verify) {
+        uint32_t total = 0;
+        for (int c = 0; c < SYMBOLS; c++) {
+            if (before[c] != total)
+                return false;
+            total += counts[c];
+        }
+        if (total != size || sampled != sampleCount)
+            return false;
+        for (size_t s = 0; s < sampleCount; s++)
+            if (samples[s] >= size)
+                return false;
+    }
+
+    m_blocks.clear();
+    m_samples.clear();
+    m_size = size;
+    copy(before, before + SYMBOLS, m_before);
+    m_blockData = block;
+    m_blockCount = blockCount;
+    m_sampleData = samples;
+    m_sampleCount = sampleCount;
+    return true;
+}
+
+int FMIndex::symbolAt(uint32_t row) const
+{
+    const Block& b = m_blockData[row / 64];
+    int bit = row % 64;
+    return int((b.planes[0] >> bit) & 1) | int((b.planes[1] >> bit) & 1) << 1 | int((b.planes[2] >> bit) & 1) << 2;
+}
+
+uint32_t FMIndex::locate(uint32_t row) const
+{
+    // step back through the text until a sampled row; sequence starts are always sampled,
+    // so the walk never has to step over a separator
+
+    uint32_t steps = 0;
+    for (;;) {
+        const Block& b = m_blockData[row / 64];
+        uint64_t bit = uint64_t(1) << (row % 64);
+        if (b.sampled & bit)
+            return m_sampleData[b.samplesBefore + __builtin_popcountll(b.sampled & (bit - 1))] + steps;
+        int symbol = symbolAt(row);
+        row = m_before[symbol] + rank(symbol, row);
+        steps++;
+    }
+}
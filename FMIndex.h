@@ -0,0 +1,131 @@
+#ifndef FMINDEX_INCLUDED
+#define FMINDEX_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "Stats.h"
+
+// FM-index over a text of symbols 0..5: 0 separates (and ends) sequences, 1..5 are
+// A, C, G, T, N. Backward search finds the suffix-array range of every occurrence of a
+// pattern of any length, one symbol at a time from the pattern's end; locate turns a
+// row of that range back into a text position.
+//
+// The BWT is stored in blocks of 64 rows: three bit planes holding each row's symbol,
+// the count of every base symbol before the block, and which of the block's rows keep
+// their suffix-array entry. Rows whose suffix starts at a multiple of SAMPLE_RATE or at
+// the start of a sequence are sampled; locate steps back through the text (LF) until it
+// reaches one. That comes to about one byte per text symbol.
+class FMIndex
+{
+public:
+    static const int SYMBOLS = 6;
+    static const int SEPARATOR = 0;
+    static const uint32_t SAMPLE_RATE = 32;
+
+        // a half-open range of suffix-array rows
+    struct Range
+    {
+        uint32_t begin;
+        uint32_t end;
+        bool empty() const { return begin >= end; }
+        uint32_t size() const { return empty() ? 0 : end - begin; }
+    };
+
+    FMIndex();
+        // text must end with SEPARATOR; the suffix array is built with a parallel radix sort
+    void build(const std::vector<unsigned char>& text, int workers);
+    size_t size() const { return m_size; }
+    size_t bytes() const;
+
+        // every row, i.e. the range of the empty pattern
+    Range all() const { return Range{ 0, static_cast<uint32_t>(m_size) }; }
+        // the rows of symbol followed by what range matched; symbol must be 1..5
+    Range extend(Range range, int symbol) const {
+        GENOMICS_COUNT(NODES_VISITED, 1);
+        return Range{ m_before[symbol] + rank(symbol, range.begin), m_before[symbol] + rank(symbol, range.end) };
+    }
+    uint32_t locate(uint32_t row) const;
+
+        // Persistence, as for Trie: besides size() and the symbol counts in before(), the
+        // index is two plain arrays, blockCount() blocks of BLOCK_BYTES from blockData() and
+        // sampleCount() text positions from sampleData(). attach() serves searches straight
+        // from such arrays, e.g. a mapped file, without copying them; build() replaces them.
+    static constexpr size_t BLOCK_BYTES = 7 * sizeof(uint64_t);
+    const uint32_t* before() const { return m_before; }
+    const void* blockData() const { return m_blockData; }
+    size_t blockCount() const { return m_blockCount; }
+    const uint32_t* sampleData() const { return m_sampleData; }
+    size_t sampleCount() const { return m_sampleCount; }
+        // False (leaving the index as it was) unless the sizes agree: one block per 64 rows
+        // and one past, before counting up to size, and the last block's samples ending at
+        // sampleCount. With verify also a pass over the blocks: their counts and sample
+        // offsets follow from the rows before them, every row holds a symbol, separator rows
+        // are sampled and every sample is inside the text, so searches and locate stay
+        // inside the arrays. Without it the blocks are taken as they are
+    bool attach(size_t size, const uint32_t* before, const void* blocks, size_t blockCount,
+                const uint32_t* samples, size_t sampleCount, bool verify = true);
+
+        // Calls visit(range) for the rows of pattern[0, length) with up to maxMismatches
+        // substitutions, none of them at pattern[0]; symbols outside 1..5 only match by
+        // substitution. Each occurrence lands in exactly one of the ranges.
+    template<typename Visit>
+    void search(const unsigned char* pattern, int length, int maxMismatches, Visit visit) const {
+        if (length <= 0 || m_size == 0)
+            return;
+        Range range = all();
+        for (int i = length - 1; i >= 0 && !range.empty(); i--) {
+                // range holds pattern[i + 1, length); first try a substitution at i
+            if (maxMismatches > 0 && i >= 1)
+                for (int c = 1; c < SYMBOLS; c++)
+                    if (c != pattern[i])
+                        finish(pattern, i, extend(range, c), visit);
+            range = valid(pattern[i]) ? extend(range, pattern[i]) : Range{ 0, 0 };
+        }
+        if (!range.empty())
+            visit(range);
+    }
+
+      // We prevent an FMIndex from being copied or assigned.
+    FMIndex(const FMIndex&) = delete;
+    FMIndex& operator=(const FMIndex&) = delete;
+private:
+    struct Block
+    {
+        uint32_t counts[SYMBOLS - 1];       // occurrences of symbols 1..5 in the rows before this block
+        uint32_t samplesBefore;
+        uint64_t planes[3];                 // bit j of plane b is bit b of row j's symbol
+        uint64_t sampled;
+    };
+
+    size_t m_size;
+    uint32_t m_before[SYMBOLS];             // rows whose suffix starts with a smaller symbol
+    std::vector<Block> m_blocks;
+    std::vector<uint32_t> m_samples;        // text positions of the sampled rows, in row order
+    const Block* m_blockData;               // m_blocks, or the attached arrays
+    size_t m_blockCount;
+    const uint32_t* m_sampleData;
+    size_t m_sampleCount;
+
+    static bool valid(int symbol) { return symbol >= 1 && symbol < SYMBOLS; }
+    uint32_t rank(int symbol, uint32_t row) const {
+        // occurrences of symbol in the BWT rows before row
+        const Block& b = m_blockData[row / 64];
+        uint64_t match = (symbol & 1 ? b.planes[0] : ~b.planes[0]) &
+                         (symbol & 2 ? b.planes[1] : ~b.planes[1]) &
+                         (symbol & 4 ? b.planes[2] : ~b.planes[2]);
+        uint64_t below = (uint64_t(1) << (row % 64)) - 1;
+        return b.counts[symbol - 1] + static_cast<uint32_t>(__builtin_popcountll(match & below));
+    }
+    int symbolAt(uint32_t row) const;
+    template<typename Visit>
+    void finish(const unsigned char* pattern, int i, Range range, Visit& visit) const {
+        // exact backward search of pattern[0, i) from range
+        for (int j = i - 1; j >= 0 && !range.empty(); j--)
+            range = valid(pattern[j]) ? extend(range, pattern[j]) : Range{ 0, 0 };
+        if (!range.empty())
+            visit(range);
+    }
+};
+
+#endif // FMINDEX_INCLUDED
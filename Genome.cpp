@@ -1,34 +1,165 @@
 #include "provided.h"
+#include "PackedDNA.h"
 #include <string>
 #include <vector>
 #include <iostream>
 #include <istream>
+#include <ostream>
+#include <memory>
+#include <functional>
 #include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "Parallel.h"
+#include "Stats.h"
 using namespace std;
 
 class GenomeImpl
 {
 public:
     GenomeImpl(const string& nm, const string& sequence);
-    static bool load(istream& genomeSource, vector<Genome>& genomes);
+    static bool load(istream& genomeSource, const function<void(Genome&&)>& add);
+    static bool load(const string& path, vector<Genome>& genomes);
     int length() const;
     string name() const;
-    bool extract(int position, int length, string& fragment) const;
-    void print();
+    bool extract(int position, int length, char* fragment) const;
+    int packedWord(int position, uint64_t& bases, uint64_t& nMask) const;
+    size_t writePacked(ostream& out) const;
+    static GenomeImpl* mapPacked(const char* block, size_t bytes, shared_ptr<const void> owner, bool checkRuns);
+    GenomeImpl(const GenomeImpl& other) = delete;
+    GenomeImpl& operator=(const GenomeImpl& rhs) = delete;
 private:
+    struct NRun {
+        unsigned int start;
+        unsigned int length;
+    };
+    struct Verbatim {
+        unsigned int position;
+        unsigned int character;
+    };
     string m_name;
-    string m_sequence;
+    vector<uint64_t> m_packed;   // A/C/G/T at 2 bits per base, N stored as A
+    vector<NRun> m_nRuns;        // sorted, non-adjacent runs of N
+    vector<Verbatim> m_verbatim; // by position, each character other than upper-case ACGTN
     unsigned int m_length;
+    
+        // the words, runs and verbatim characters actually read: the vectors above, or a
+        // block inside a mapped file (mapPacked) that m_owner keeps alive, in which case the
+        // vectors stay empty
+    const uint64_t* m_words;
+    const NRun* m_runs;
+    size_t m_runCount;
+    const Verbatim* m_verbatims;
+    size_t m_verbatimCount;
+    shared_ptr<const void> m_owner;
+    
+    GenomeImpl() {}
+    void useOwnStorage();
+
+    const NRun* firstRunEndingAfter(unsigned int position) const;
+    uint64_t nMaskFor(unsigned int position, int count) const;
 };
 
 GenomeImpl::GenomeImpl(const string& nm, const string& sequence)
 {
     m_name = nm;
-    m_sequence = sequence;
     m_length = static_cast<int>(sequence.length());
+    m_packed.assign(PackedDNA::wordsFor(m_length), 0);
+    
+        // pack each base into its word; anything other than ACGT (either case) is recorded as
+        // N. The packed form is what matching reads; so that extract() still gives back the
+        // sequence as it was passed in, a character that isn't upper-case ACGTN is also kept
+        // as it is (Genome::load upper-cases and validates, so its genomes keep none)
+    for (unsigned int i = 0; i < m_length; i++) {
+        char c = sequence[i];
+        if (c != 'A' && c != 'C' && c != 'G' && c != 'T' && c != 'N')
+            m_verbatim.push_back({i, static_cast<unsigned char>(c)});
+        int code = PackedDNA::baseCode(c);
+        if (code >= 0) {
+            m_packed[i / PackedDNA::BASES_PER_WORD] |= uint64_t(code) << (2 * (i % PackedDNA::BASES_PER_WORD));
+            continue;
+        }
+        if (!m_nRuns.empty() && m_nRuns.back().start + m_nRuns.back().length == i)
+            m_nRuns.back().length++;
+        else
+            m_nRuns.push_back({i, 1});
+    }
+    useOwnStorage();
+}
+
+void GenomeImpl::useOwnStorage()
+{
+    m_words = m_packed.data();
+    m_runs = m_nRuns.data();
+    m_runCount = m_nRuns.size();
+    m_verbatims = m_verbatim.data();
+    m_verbatimCount = m_verbatim.size();
+}
+
+    // A packed block is a 16-byte header (length, name length, N run count, verbatim count)
+    // followed by the packed words, the N runs, the verbatim characters and the name, padded
+    // to a multiple of 8 bytes so the next block's words are aligned too.
+size_t GenomeImpl::writePacked(ostream& out) const
+{
+    uint32_t header[4] = { m_length, uint32_t(m_name.size()), uint32_t(m_runCount), uint32_t(m_verbatimCount) };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(m_words), PackedDNA::wordsFor(m_length) * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(m_runs), m_runCount * sizeof(NRun));
+    out.write(reinterpret_cast<const char*>(m_verbatims), m_verbatimCount * sizeof(Verbatim));
+    out.write(m_name.data(), m_name.size());
+    
+    size_t size = sizeof(header) + PackedDNA::wordsFor(m_length) * sizeof(uint64_t) + m_runCount * sizeof(NRun) +
+        m_verbatimCount * sizeof(Verbatim) + m_name.size();
+    size_t padding = (8 - size % 8) % 8;
+    out.write("\0\0\0\0\0\0\0", padding);
+    return size + padding;
 }
 
-bool GenomeImpl::load(istream& genomeSource, vector<Genome>& genomes) 
+GenomeImpl* GenomeImpl::mapPacked(const char* block, size_t bytes, shared_ptr<const void> owner, bool checkRuns)
+{
+    // nullptr unless the block's parts fit in bytes, and (if checkRuns) its N runs and verbatim
+    // characters are in order and inside the sequence, as extract() and packedWord() rely on
+    
+    const uint32_t* header = reinterpret_cast<const uint32_t*>(block);
+    if (bytes < 4 * sizeof(uint32_t))
+        return nullptr;
+    uint64_t size = 4 * sizeof(uint32_t) + PackedDNA::wordsFor(header[0]) * sizeof(uint64_t) +
+        uint64_t(header[2]) * sizeof(NRun) + uint64_t(header[3]) * sizeof(Verbatim) + header[1];
+    if (size > bytes)
+        return nullptr;
+    const NRun* runs = reinterpret_cast<const NRun*>(block + 4 * sizeof(uint32_t) + PackedDNA::wordsFor(header[0]) * sizeof(uint64_t));
+    uint64_t end = 0;
+    for (uint32_t i = 0; checkRuns && i < header[2]; i++) {
+        if (runs[i].start < end || runs[i].length == 0 || uint64_t(runs[i].start) + runs[i].length > header[0])
+            return nullptr;
+        end = uint64_t(runs[i].start) + runs[i].length;
+    }
+    const Verbatim* verbatims = reinterpret_cast<const Verbatim*>(runs + header[2]);
+    for (uint32_t i = 0; checkRuns && i < header[3]; i++)
+        if (verbatims[i].position >= header[0] || (i > 0 && verbatims[i].position <= verbatims[i - 1].position))
+            return nullptr;
+    
+    GenomeImpl* impl = new GenomeImpl;
+    impl->m_length = header[0];
+    impl->m_words = reinterpret_cast<const uint64_t*>(block + 4 * sizeof(uint32_t));
+    impl->m_runs = reinterpret_cast<const NRun*>(impl->m_words + PackedDNA::wordsFor(impl->m_length));
+    impl->m_runCount = header[2];
+    impl->m_verbatims = reinterpret_cast<const Verbatim*>(impl->m_runs + impl->m_runCount);
+    impl->m_verbatimCount = header[3];
+    impl->m_name.assign(reinterpret_cast<const char*>(impl->m_verbatims + impl->m_verbatimCount), header[1]);
+    impl->m_owner = owner;
+    return impl;
+}
+
+bool GenomeImpl::load(istream& genomeSource, const function<void(Genome&&)>& add) 
 {
     std::string line;
     std::string name;
@@ -38,7 +169,7 @@ bool GenomeImpl::load(istream& genomeSource, vector<Genome>& genomes)
         if (line[0] == '>') {
                 // if start of new sequence, create Genome object with previous sequence
             if (name != "" && genome != "")
-                genomes.push_back(Genome(name, genome));
+                add(Genome(name, genome));
             
                 // if invalid state, return false
             if (line.size() == 1 || !isalnum(line[1]))
@@ -54,7 +185,7 @@ bool GenomeImpl::load(istream& genomeSource, vector<Genome>& genomes)
             return false;
         
             // check each character to see if they are ACTGN
-        for (int i = 0; i < line.size(); i ++) {
+        for (size_t i = 0; i < line.size(); i ++) {
             char c = toupper(line[i]);
             line[i] = c;
             switch (c) {
@@ -75,12 +206,137 @@ bool GenomeImpl::load(istream& genomeSource, vector<Genome>& genomes)
     if (name == "" || genome == "")
         return false;
     
-        // push last Genome object into genomes
-    genomes.push_back(Genome(name, genome));
+        // hand on the last Genome object
+    add(Genome(name, genome));
+    
+    return true;
+}
+
+static bool copyBases(const char* from, size_t count, char* to)
+{
+    // copies one sequence line upper-cased, returning false if anything in it is not ACGTN;
+    // clearing bit 5 upper-cases a letter, and a byte is valid exactly when that gives A, C, G, T or N
     
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i caseBit = _mm_set1_epi8(~0x20);
+    const __m128i a = _mm_set1_epi8('A'), c = _mm_set1_epi8('C'), g = _mm_set1_epi8('G');
+    const __m128i t = _mm_set1_epi8('T'), n = _mm_set1_epi8('N');
+    for (; i + 16 <= count; i += 16) {
+        __m128i upper = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i)), caseBit);
+        __m128i valid = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(upper, a), _mm_cmpeq_epi8(upper, c)),
+                                     _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(upper, g), _mm_cmpeq_epi8(upper, t)), _mm_cmpeq_epi8(upper, n)));
+        if (_mm_movemask_epi8(valid) != 0xFFFF)
+            return false;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(to + i), upper);
+    }
+#endif
+    for (; i < count; i++) {
+        char upper = from[i] & ~0x20;
+        switch (upper) {
+            case 'A':
+            case 'G':
+            case 'T':
+            case 'C':
+            case 'N':
+                to[i] = upper;
+                break;
+            default:
+                return false;
+        }
+    }
     return true;
 }
 
+bool GenomeImpl::load(const string& path, vector<Genome>& genomes)
+{
+    // same result as load(istream&) on the file, but the file is mapped rather than read,
+    // records are parsed on several threads, and each sequence is validated and upper-cased
+    // a vector at a time straight into a buffer sized for the whole record
+    
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    const char* data = static_cast<const char*>(mapping);
+    
+        // every record starts at a '>' that begins a line; a file that doesn't start with one
+        // has a line before any name, which load(istream&) rejects
+    vector<size_t> starts;
+    for (const char* p = data; p != nullptr && p < data + size; p = static_cast<const char*>(memchr(p + 1, '>', data + size - p - 1)))
+        if (*p == '>' && (p == data || p[-1] == '\n'))
+            starts.push_back(p - data);
+    if (starts.empty() || starts[0] != 0) {
+        munmap(mapping, size);
+        return false;
+    }
+    starts.push_back(size);
+    
+    struct Record {
+        bool valid;
+        Genome* genome;         // nullptr if the record had no bases
+    };
+    int count = static_cast<int>(starts.size()) - 1;
+    vector<Record> records(count);
+    
+    parallelForChunks(count, 1, max(1, int(thread::hardware_concurrency())), [&](int, int begin, int end) {
+        for (int r = begin; r < end; r++) {
+            const char* p = data + starts[r];
+            const char* recordEnd = data + starts[r + 1];
+            const char* lineEnd = static_cast<const char*>(memchr(p, '\n', recordEnd - p));
+            if (lineEnd == nullptr)
+                lineEnd = recordEnd;
+            
+                // if invalid state, the record (and so the load) fails
+            records[r].valid = false;
+            records[r].genome = nullptr;
+            if (lineEnd - p == 1 || !isalnum(static_cast<unsigned char>(p[1])))
+                continue;
+            string name(p + 1, lineEnd);
+            
+                // copy each line's bases into place; the record can't hold more bases than bytes
+            string sequence(recordEnd - lineEnd, 'N');
+            size_t length = 0;
+            bool valid = true;
+            for (p = lineEnd; p < recordEnd && valid; p = lineEnd) {
+                p++;
+                lineEnd = static_cast<const char*>(memchr(p, '\n', recordEnd - p));
+                if (lineEnd == nullptr)
+                    lineEnd = recordEnd;
+                valid = copyBases(p, lineEnd - p, &sequence[length]);
+                length += lineEnd - p;
+            }
+            sequence.resize(length);
+            records[r].valid = valid;
+            if (valid && length > 0)
+                records[r].genome = new Genome(name, sequence);
+        }
+    });
+    munmap(mapping, size);
+    
+        // replay what load(istream&) would have kept: a record is pushed when the next header is read,
+        // records without bases are skipped, and the last one must have bases
+    bool result = true;
+    for (int r = 0; r < count && result; r++) {
+        if (!records[r].valid || (records[r].genome == nullptr && r == count - 1))
+            result = false;
+        else if (records[r].genome != nullptr)
+            genomes.push_back(move(*records[r].genome));
+    }
+    for (int r = 0; r < count; r++)
+        delete records[r].genome;
+    return result;
+}
+
 int GenomeImpl::length() const
 {
     return m_length;
@@ -91,48 +347,106 @@ string GenomeImpl::name() const
     return m_name;
 }
 
-bool GenomeImpl::extract(int position, int length, string& fragment) const
+bool GenomeImpl::extract(int position, int length, char* fragment) const
 {
         // if length causes out of bounds, or position/length are invalid values, return false
-    if (position + length > m_length || position < 0 || length < 0)
+    if (position < 0 || length < 0 || position + length > static_cast<int>(m_length))
         return false;
+    GENOMICS_COUNT(EXTRACT_CALLS, 1);
+    GENOMICS_COUNT(EXTRACT_BYTES, length);
     
-        // set fragment to substring and return true
-    fragment = m_sequence.substr(position, length);
+        // decode the packed bases, then paint any N runs and verbatim characters that overlap the range back in
+    for (int i = 0; i < length; i++) {
+        unsigned int p = position + i;
+        fragment[i] = PackedDNA::codeBase(int(m_words[p / PackedDNA::BASES_PER_WORD] >> (2 * (p % PackedDNA::BASES_PER_WORD))));
+    }
+    
+    auto run = firstRunEndingAfter(position);
+    for (; run != m_runs + m_runCount && run->start < unsigned(position + length); run++) {
+        unsigned int from = max(run->start, unsigned(position));
+        unsigned int to = min(run->start + run->length, unsigned(position + length));
+        fill(fragment + (from - position), fragment + (to - position), 'N');
+    }
+    
+    auto verbatim = lower_bound(m_verbatims, m_verbatims + m_verbatimCount, unsigned(position), [](const Verbatim& v, unsigned int p) { return v.position < p; });
+    for (; verbatim != m_verbatims + m_verbatimCount && verbatim->position < unsigned(position + length); verbatim++)
+        fragment[verbatim->position - position] = static_cast<char>(verbatim->character);
     return true;
 }
 
+int GenomeImpl::packedWord(int position, uint64_t& bases, uint64_t& nMask) const
+{
+    bases = 0;
+    nMask = 0;
+    if (position < 0 || unsigned(position) >= m_length)
+        return 0;
+    
+        // a word-aligned read is one load; otherwise stitch the tail of one word to the head of the next
+    int count = static_cast<int>(min(m_length - unsigned(position), unsigned(PackedDNA::BASES_PER_WORD)));
+    size_t word = position / PackedDNA::BASES_PER_WORD;
+    int shift = 2 * (position % PackedDNA::BASES_PER_WORD);
+    bases = m_words[word] >> shift;
+    if (shift != 0 && word + 1 < PackedDNA::wordsFor(m_length))
+        bases |= m_words[word + 1] << (64 - shift);
+    bases &= PackedDNA::lowBases(count);
+    
+    if (m_runCount != 0)
+        nMask = nMaskFor(position, count);
+    return count;
+}
+
+const GenomeImpl::NRun* GenomeImpl::firstRunEndingAfter(unsigned int position) const
+{
+    return upper_bound(m_runs, m_runs + m_runCount, position, [](unsigned int p, const NRun& r) { return p < r.start + r.length; });
+}
+
+uint64_t GenomeImpl::nMaskFor(unsigned int position, int count) const
+{
+    // 0b11 for every base in [position, position+count) covered by an N run
+    
+    uint64_t mask = 0;
+    auto run = firstRunEndingAfter(position);
+    for (; run != m_runs + m_runCount && run->start < position + count; run++) {
+        unsigned int from = max(run->start, position) - position;
+        unsigned int to = min(run->start + run->length, position + count) - position;
+        mask |= PackedDNA::lowBases(to) & ~PackedDNA::lowBases(from);
+    }
+    return mask;
+}
+
 //******************** Genome functions ************************************
 
 // These functions simply delegate to GenomeImpl's functions.
 // You probably don't want to change any of this code.
 
 Genome::Genome(const string& nm, const string& sequence)
+    : m_impl(new GenomeImpl(nm, sequence))
 {
-    m_impl = new GenomeImpl(nm, sequence);
 }
 
 Genome::~Genome()
 {
-    delete m_impl;
 }
 
-Genome::Genome(const Genome& other)
+    // copies share the immutable GenomeImpl; nothing is ever written through m_impl
+Genome::Genome(const Genome& other) = default;
+Genome::Genome(Genome&& other) noexcept = default;
+Genome& Genome::operator=(const Genome& rhs) = default;
+Genome& Genome::operator=(Genome&& rhs) noexcept = default;
+
+bool Genome::load(istream& genomeSource, vector<Genome>& genomes) 
 {
-    m_impl = new GenomeImpl(*other.m_impl);
+    return GenomeImpl::load(genomeSource, [&genomes](Genome&& genome) { genomes.push_back(move(genome)); });
 }
 
-Genome& Genome::operator=(const Genome& rhs)
+bool Genome::load(istream& genomeSource, const function<void(Genome&&)>& add)
 {
-    GenomeImpl* newImpl = new GenomeImpl(*rhs.m_impl);
-    delete m_impl;
-    m_impl = newImpl;
-    return *this;
+    return GenomeImpl::load(genomeSource, add);
 }
 
-bool Genome::load(istream& genomeSource, vector<Genome>& genomes) 
+bool Genome::load(const string& path, vector<Genome>& genomes)
 {
-    return GenomeImpl::load(genomeSource, genomes);
+    return GenomeImpl::load(path, genomes);
 }
 
 int Genome::length() const
@@ -146,6 +460,38 @@ string Genome::name() const
 }
 
 bool Genome::extract(int position, int length, string& fragment) const
+{
+    if (position + length > m_impl->length() || position < 0 || length < 0)
+        return false;
+    fragment.resize(length);
+    return m_impl->extract(position, length, &fragment[0]);
+}
+
+bool Genome::extract(int position, int length, char* fragment) const
 {
     return m_impl->extract(position, length, fragment);
 }
+
+int Genome::packedWord(int position, uint64_t& bases, uint64_t& nMask) const
+{
+    return m_impl->packedWord(position, bases, nMask);
+}
+
+size_t Genome::writePacked(ostream& out) const
+{
+    return m_impl->writePacked(out);
+}
+
+bool Genome::mapPacked(const char* block, size_t bytes, shared_ptr<const void> owner, Genome& genome, bool checkRuns)
+{
+    const GenomeImpl* impl = GenomeImpl::mapPacked(block, bytes, owner, checkRuns);
+    if (impl == nullptr)
+        return false;
+    genome = Genome(impl);
+    return true;
+}
+
+Genome::Genome(const GenomeImpl* impl)
+    : m_impl(impl)
+{
+}
@@ -1,242 +1,1680 @@
 #include "provided.h"
 #include "Trie.h"
+#include "PostingList.h"
+#include "Parallel.h"
+#include "RadixSort.h"
+#include "PackedDNA.h"
+#include "IndexFile.h"
+#include "Minimizer.h"
+#include "FMIndex.h"
+#include "Stats.h"
+#include "ResultCache.h"
+#include "Sketch.h"
+#include "Epoch.h"
+#include "BoundedQueue.h"
 #include <string>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <utility>
 #include <unordered_map>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
 #include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
 using namespace std;
 
-using Pair = pair<string, int>;
-using PairVector = vector<Pair>;
+    // best match found in one genome: how long, where it starts, and on which strand
+struct Candidate
+{
+    int length;
+    int position;
+    bool reverse;
+};
+
+    // the best match per genome ID of one query, without a hash table: best is indexed by
+    // genome ID (length -1 where there is none yet) and ids lists the IDs that have one
+struct CandidateSet
+{
+    vector<Candidate> best;
+    vector<uint32_t> ids;
+    
+        // empties the set, sized for genome IDs below genomes
+    void reset(size_t genomes) {
+        for (uint32_t id : ids)
+            best[id].length = -1;
+        ids.clear();
+        if (best.size() < genomes)
+            best.resize(genomes, Candidate{ -1, 0, false });
+    }
+    bool empty() const { return ids.empty(); }
+};
+
+    // k-mer keys as encodeKmers packs them: 3-bit symbols, this many to a 64-bit word
+const int SYMBOLS_PER_WORD = 21;
+
+    // the key symbol (0..4, ACGTN) of the complementary base; N stays N
+static unsigned char complementSymbol(unsigned char symbol)
+{
+    return symbol < 4 ? 3 - symbol : 4;
+}
+
+    // a stretch of bases packed as Genome::packedWord hands them out, laid out from base 0,
+    // so PackedDNA::firstDifference can compare two of them 32+ bases at a time
+struct PackedBases
+{
+    vector<uint64_t> bases;
+    vector<uint64_t> nMask;
+    int length;
+};
+
+    // One immutable piece of the k-mer index: the postings of some genomes, in a trie of its
+    // own. Its posting lists live in the trie, or, for a library opened from a file, in the
+    // mapped file that the trie is attached to.
+struct Segment
+{
+    Trie<Posting, PostingList> trie;
+    uint64_t postingCount = 0;
+    vector<pair<uint32_t, uint32_t>> genomes;   // (ID, bases) of every genome it has postings for
+    shared_ptr<const void> mapping;
+    const IndexFile::IndexList* mappedLists = nullptr;
+    uint64_t mappedListCount = 0;
+    const unsigned char* mappedPool = nullptr;
+    
+    uint32_t listCount() const {
+        return mappedLists != nullptr ? static_cast<uint32_t>(mappedListCount) : trie.listCount();
+    }
+    void postings(uint32_t list, PostingList::const_iterator& begin, PostingList::const_iterator& end) const {
+        if (mappedLists != nullptr) {
+            const unsigned char* from = mappedPool + mappedLists[list].offset;
+            begin = PostingList::const_iterator(from, from + mappedLists[list].bytes);
+        }
+        else
+            begin = trie.values(list).begin();
+        end = PostingList::const_iterator();
+    }
+};
+
+    // a library genome as snapshots share it: the genome, its name for results, and its sketch
+struct GenomeEntry
+{
+    Genome genome;
+    string name;
+    vector<uint64_t> sketch;                // sorted FracMinHash hashes, with MatcherOptions::sketchScale
+    const uint64_t* hashes = nullptr;       // the sketch as read: sketch's, or in the genome's mapped file
+    size_t hashCount = 0;
+    
+    GenomeEntry(const Genome& g) : genome(g), name(g.name()) {}
+};
+
+    // the FM_INDEX backend: one text of every live genome, each followed by a separator;
+    // genome ids[i] starts at text position starts[i]. The index of a library opened from a
+    // file is attached to the mapped file.
+struct FMState
+{
+    FMIndex index;
+    vector<uint32_t> starts;
+    vector<uint32_t> ids;
+    shared_ptr<const void> mapping;
+};
+
+    // One version of the library, everything a query reads. It never changes once published:
+    // a change builds the next version beside it and swaps it in, so a query sees the same
+    // library from start to end without locking.
+struct Snapshot
+{
+    vector<shared_ptr<const GenomeEntry>> genomes;      // by genome ID, null once removed or superseded
+    vector<shared_ptr<const Segment>> segments;         // k-mer index, oldest genomes first
+    shared_ptr<const FMState> fm;
+    uint64_t version = 0;
+    
+        // postings of removed genomes stay in the segments, skipped, until they are merged away
+    bool isDead(uint32_t id) const { return genomes[id] == nullptr; }
+    
+        // (ID, bases) of the live genomes from firstId on, for a segment indexing them
+    vector<pair<uint32_t, uint32_t>> genomesFrom(uint32_t firstId) const {
+        vector<pair<uint32_t, uint32_t>> held;
+        for (uint32_t id = firstId; id < genomes.size(); id++)
+            if (!isDead(id))
+                held.push_back(make_pair(id, static_cast<uint32_t>(genomes[id]->genome.length())));
+        return held;
+    }
+        // bases of the genomes segment has postings for that are removed in this version
+    uint64_t deadBases(const Segment& segment) const {
+        uint64_t dead = 0;
+        for (const auto& held : segment.genomes)
+            if (isDead(held.first))
+                dead += held.second;
+        return dead;
+    }
+};
+
+    // a segment value list to check a fragment against, and where in the fragment its k-mer starts
+    // (0 for the prefix; a minimizer can sit further in)
+struct ListHit
+{
+    const Segment* segment;
+    uint32_t list;
+    int offset;
+};
+
+    // buffers one query at a time reuses; each thread keeps one (threadScratch) for every
+    // query it runs, so once they have grown to fit, queries allocate nothing
+struct QueryScratch
+{
+    CandidateSet results;
+    string text;                            // a fragment of findRelatedGenomes' query
+    PackedBases fragment;
+    PackedBases window;
+    vector<ListHit> lists;                  // value lists of the trie nodes the fragment's keys matched
+    
+        // minimizer lookups: the fragment's first window as symbols, its k-mer values, and the
+        // keys to look up, key i being keyText[keys[i].first, +k) at fragment offset keys[i].second
+        // (for prefixKeys, with keys[i].second mismatches)
+    vector<unsigned char> symbols;
+    vector<uint64_t> values;
+    vector<uint64_t> powers;
+    string keyText;
+    vector<pair<int, int>> keys;
+    
+    vector<uint32_t> positions;             // FM-index occurrences, as text positions
+    
+    string cacheKey;                        // the fragment's result cache key; empty if it has none
+    vector<pair<uint32_t, Candidate>> cached;
+    vector<string> names;                   // names of result entries a caller's vector shed, kept for it to grow back into
+    
+        // findRelatedGenomes only counts which genomes match: with only set, just the genome IDs
+        // marked there are verified, the first match found for each is kept, and the search
+        // stops once wanted of them have one
+    const vector<char>* only = nullptr;
+    size_t wanted = 0;
+};
 
 class GenomeMatcherImpl
 {
 public:
-    GenomeMatcherImpl(int minSearchLength);
+    GenomeMatcherImpl(int minSearchLength, const MatcherOptions& options);
     void addGenome(const Genome& genome);
+    void addGenomes(const vector<Genome>& genomes);
+    bool addGenomes(istream& fasta);
+    bool removeGenome(const string& name);
+    bool replaceGenome(const Genome& genome);
     int minimumSearchLength() const;
+    void setWorkerCount(int workers);
+    void setResultCacheSize(size_t bytes);
     bool findGenomesWithThisDNA(const string& fragment, int minimumLength, bool exactMatchOnly, vector<DNAMatch>& matches) const;
+    bool findGenomesWithThisDNA(const vector<string>& fragments, int minimumLength, bool exactMatchOnly, vector<vector<DNAMatch>>& matches) const;
     bool findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, vector<GenomeMatch>& results) const;
+    bool findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, int maxResults, vector<GenomeMatch>& results) const;
+    bool estimateRelatedGenomes(const Genome& query, int fragmentMatchLength, double matchPercentThreshold, vector<GenomeMatch>& results) const;
+    bool save(const string& path) const;
+    bool open(const string& path, bool verifyChecksum);
+    MatcherStats stats() const;
+    void resetStats();
     ~GenomeMatcherImpl();
 private:
-    Trie<Pair>* m_library;
     int m_minLength;
-    unordered_map<string, const Genome*> genomeLibrary;
+    MatcherOptions m_options;
+    int m_workers;                                  // threads findRelatedGenomes may use
+    
+        // The library as queries see it. A query pins an epoch and reads whatever snapshot is
+        // current, taking no lock; a change builds the next snapshot under m_writer, swaps it
+        // in, and retires the old one, which is deleted once no query can still be reading it.
+    atomic<const Snapshot*> m_current;
+    mutable mutex m_writer;
+    Epoch::Retired m_retired;                       // under m_writer
+    uint64_t m_version;
     
-    static bool PairComp(Pair x, Pair y);
+        // writer-side bookkeeping, under m_writer: the live genome of each name, and how many
+        // bases the segments index (m_deadBases of them for removed genomes)
+    unordered_map<string, uint32_t> m_genomeIds;
+    uint64_t m_indexedBases;
+    uint64_t m_deadBases;
+    
+        // merges segments and drops removed genomes' postings in the background
+    thread m_compactor;
+    atomic<bool> m_compacting;
+    atomic<bool> m_stopCompacting;
+    
+        // best match per genome ID of recent fragments; emptied whenever the library changes
+    mutable ResultCache<vector<pair<uint32_t, Candidate>>> m_cache;
+    
+#ifdef GENOMICS_STATS
+    mutable Stats::Totals m_stats;
+#endif
+    
+    const Snapshot& current() const { return *m_current.load(); }
+    void publish(Snapshot* next);
+    vector<shared_ptr<GenomeEntry>> makeEntries(const vector<Genome>& genomes) const;
+    uint32_t registerEntries(Snapshot& next, const vector<shared_ptr<GenomeEntry>>& entries);
+    void addEntries(const vector<shared_ptr<GenomeEntry>>& entries);
+    void maybeCompact();
+    bool compactionRange(const Snapshot& snapshot, size_t& from, size_t& to) const;
+    void compact();
+    shared_ptr<Segment> mergeSegments(const Snapshot& snapshot, size_t from, size_t to) const;
+    void indexGenomes(const Snapshot& snapshot, uint32_t firstId, Segment& segment);
+    void encodeKmers(const vector<const Genome*>& genomes, const function<void(vector<uint64_t>&, size_t)>& sorted) const;
+    void loadKmers(const vector<uint64_t>& records, size_t count, uint32_t firstId, Segment& segment) const;
+    void sketchGenomes(vector<shared_ptr<GenomeEntry>>& entries) const;
+    void containment(const Snapshot& snap, const Genome& query, int fragmentMatchLength, vector<double>& estimates, int& sampled) const;
+    static void symbols(const Genome& genome, vector<unsigned char>& result);
+    shared_ptr<const FMState> buildFMIndex(const Snapshot& snapshot) const;
+    static bool isBetter(const Candidate& x, const Candidate& y);
     static bool sortGenomeMatch(GenomeMatch x, GenomeMatch y);
-    bool isAMatch(string& sequence, const string& fragment, int minLength) const;
-    bool isASNiP(string& sequence, const string& fragment, int minLength) const;
-    unordered_map<string, PairVector> findGenomesHelper(const string& fragment, int minLength) const;
+    static void pack(const string& fragment, PackedBases& packed);
+    static bool pack(const Genome& genome, int position, int length, PackedBases& packed);
+    bool isAMatch(const PackedBases& sequence, const PackedBases& fragment, int minLength, int mismatches, int& length) const;
+    bool findMatches(const Snapshot& snap, const string& fragment, int minimumLength, bool exactMatchOnly, QueryScratch& scratch, CandidateSet& results) const;
+    bool cachedMatches(const Snapshot& snap, const string& fragment, int minimumLength, bool exactMatchOnly, QueryScratch& scratch, CandidateSet& results) const;
+    void cacheMatches(QueryScratch& scratch, const CandidateSet& results) const;
+    static QueryScratch& threadScratch();
+    void minimizerLookups(const Snapshot& snap, const string& fragment, int mismatches, QueryScratch& scratch) const;
+    void prefixKeys(string_view prefix, int mismatches, QueryScratch& scratch) const;
+    void findGenomesHelper(const Snapshot& snap, const string& fragment, int minLength, int mismatches, QueryScratch& scratch, CandidateSet& matches) const;
+    bool checkPostings(const Snapshot& snap, const Segment& segment, uint32_t list, int offset, int minLength, int mismatches, QueryScratch& scratch, CandidateSet& matches) const;
+    bool settled(const Snapshot& snap, uint32_t id, int pos, const QueryScratch& scratch, const CandidateSet& matches) const;
+    void findWithFMIndex(const Snapshot& snap, const string& fragment, int minLength, int mismatches, QueryScratch& scratch, CandidateSet& matches) const;
+    void checkCandidate(const Snapshot& snap, uint32_t id, int pos, bool reverse, int minLength, int mismatches, QueryScratch& scratch, CandidateSet& matches) const;
+    static void keepBest(uint32_t id, const Candidate& candidate, CandidateSet& matches);
+    void reportMatches(const Snapshot& snap, CandidateSet& results, vector<DNAMatch>& matches) const;
 };
 
-GenomeMatcherImpl::GenomeMatcherImpl(int minSearchLength)
+GenomeMatcherImpl::GenomeMatcherImpl(int minSearchLength, const MatcherOptions& options)
 {
     m_minLength = minSearchLength;
-    m_library = new Trie<Pair>;
+    m_options = options;
+    if (m_options.minimizerWindow < 1)
+        m_options.minimizerWindow = 1;
+    if (m_options.indexMode != MatcherOptions::ALL_KMERS)
+        m_options.bothStrands = false;
+    m_workers = 1;
+    Snapshot* empty = new Snapshot;
+    if (m_options.indexMode == MatcherOptions::FM_INDEX)
+        empty->fm = make_shared<const FMState>();
+    m_current = empty;
+    m_version = 0;
+    m_indexedBases = 0;
+    m_deadBases = 0;
+    m_compacting = false;
+    m_stopCompacting = false;
 }
 
 GenomeMatcherImpl::~GenomeMatcherImpl() {
-    delete m_library;
+        // no query may be running any more, so m_retired can free whatever it still holds
+    m_stopCompacting = true;
+    if (m_compactor.joinable())
+        m_compactor.join();
+    delete m_current.load();
+}
+
+void GenomeMatcherImpl::addGenome(const Genome& genome)
+{
+    vector<shared_ptr<GenomeEntry>> entries = makeEntries(vector<Genome>(1, genome));
+    lock_guard<mutex> lock(m_writer);
+    addEntries(entries);
+    maybeCompact();
+}
+
+void GenomeMatcherImpl::addGenomes(const vector<Genome>& genomes)
+{
+        // the whole batch goes into one segment, its k-mers sorted and loaded together
+    vector<shared_ptr<GenomeEntry>> entries = makeEntries(genomes);
+    lock_guard<mutex> lock(m_writer);
+    addEntries(entries);
+    maybeCompact();
+}
+
+bool GenomeMatcherImpl::addGenomes(istream& fasta)
+{
+    // Streams a FASTA source into the library in three stages that overlap, each on a thread
+    // of its own: parsing records into batches of about INGEST_BASES bases; sketching a batch
+    // and encoding and sorting its k-mers (spread over the workers); and loading each sorted
+    // run into the batch's segment, published together with the batch's genomes once the last
+    // run is in. Bounded queues between the stages hold the parser and the encoder back to the
+    // loader's pace, so only a few batches and runs are in flight however long the input is.
+    // An FM-index can't take a batch at a time, so in FM_INDEX mode the genomes are published
+    // together at the end, with one build; there the batches pile up in pending (the entries
+    // the library keeps anyway) and memory is bounded by nothing but the input.
+    
+    const size_t INGEST_BASES = size_t(1) << 24;
+    const size_t QUEUE_DEPTH = 2;
+    typedef vector<shared_ptr<GenomeEntry>> Batch;
+    struct Run {
+        shared_ptr<const Batch> batch;
+        vector<uint64_t> records;           // from encodeKmers, count of them
+        size_t count = 0;
+        bool last = false;                  // no records; the batch is complete
+    };
+    bool fm = m_options.indexMode == MatcherOptions::FM_INDEX;
+    BoundedQueue<vector<Genome>> parsed(QUEUE_DEPTH);
+    BoundedQueue<Run> sorted(QUEUE_DEPTH);
+    
+    bool result = true;
+    thread parser([&]() {
+        vector<Genome> batch;
+        size_t bases = 0;
+        result = Genome::load(fasta, [&](Genome&& genome) {
+            bases += genome.length();
+            batch.push_back(move(genome));
+            if (bases >= INGEST_BASES) {
+                parsed.push(move(batch));
+                batch.clear();
+                bases = 0;
+            }
+        });
+        if (!batch.empty())
+            parsed.push(move(batch));
+        parsed.close();
+    });
+    
+    thread encoder([&]() {
+        vector<Genome> genomes;
+        vector<const Genome*> pointers;
+        while (parsed.pop(genomes)) {
+            shared_ptr<const Batch> batch = make_shared<const Batch>(makeEntries(genomes));
+                // an FM_INDEX batch has no k-mers to sort; it only has to reach the loader
+            if (!fm) {
+                pointers.clear();
+                for (size_t i = 0; i < batch->size(); i++)
+                    pointers.push_back(&(*batch)[i]->genome);
+                encodeKmers(pointers, [&](vector<uint64_t>& records, size_t count) {
+                    Run run;
+                    run.batch = batch;
+                    run.records = move(records);
+                    run.count = count;
+                    sorted.push(move(run));
+                });
+            }
+            Run end;
+            end.batch = batch;
+            end.last = true;
+            sorted.push(move(end));
+        }
+        sorted.close();
+    });
     
-    for (auto it = genomeLibrary.begin(); it != genomeLibrary.end(); it++) {
-        pair<string, const Genome*> item = *it;
-        delete item.second;
+        // the loader holds the writer lock from a batch's first run to its last, so the IDs its
+        // genomes are registered under stay the ones its postings are loaded with
+    unique_lock<mutex> lock(m_writer, defer_lock);
+    Snapshot* next = nullptr;
+    shared_ptr<Segment> segment;
+    uint32_t firstId = 0;
+    Batch pending;
+    Run run;
+    while (sorted.pop(run)) {
+        if (fm) {
+            pending.insert(pending.end(), run.batch->begin(), run.batch->end());
+            continue;
+        }
+        if (next == nullptr) {
+            lock.lock();
+            next = new Snapshot(current());
+            firstId = registerEntries(*next, *run.batch);
+            segment = make_shared<Segment>();
+            segment->genomes = next->genomesFrom(firstId);
+        }
+        loadKmers(run.records, run.count, firstId, *segment);
+        if (run.last) {
+            if (!segment->genomes.empty())
+                next->segments.push_back(segment);
+            publish(next);
+            next = nullptr;
+            maybeCompact();
+            lock.unlock();
+        }
+    }
+    if (!pending.empty()) {
+        lock.lock();
+        addEntries(pending);
+        maybeCompact();
+        lock.unlock();
     }
+    parser.join();
+    encoder.join();
+    return result;
 }
 
-void GenomeMatcherImpl::addGenome(const Genome& genome)
+bool GenomeMatcherImpl::removeGenome(const string& name)
+{
+    lock_guard<mutex> lock(m_writer);
+    auto found = m_genomeIds.find(name);
+    if (found == m_genomeIds.end())
+        return false;
+    Snapshot* next = new Snapshot(current());
+    m_deadBases += next->genomes[found->second]->genome.length();
+    next->genomes[found->second] = nullptr;
+    m_genomeIds.erase(found);
+    publish(next);
+    maybeCompact();
+    return true;
+}
+
+bool GenomeMatcherImpl::replaceGenome(const Genome& genome)
+{
+        // re-adding a name already supersedes the old genome
+    lock_guard<mutex> lock(m_writer);
+    if (m_genomeIds.count(genome.name()) == 0)
+        return false;
+    addEntries(makeEntries(vector<Genome>(1, genome)));
+    maybeCompact();
+    return true;
+}
+
+void GenomeMatcherImpl::publish(Snapshot* next)
 {
-    Genome* insert = new Genome(genome);
-    genomeLibrary[genome.name()] = insert;
+    // makes next the snapshot queries see; called with m_writer held. Queries still reading the
+    // old one keep it until they finish, and the cache is emptied (its keys carry the version,
+    // so an answer from the old snapshot put back afterwards is never found)
     
-        // index will keep track of where the next subsequence is, and sequence contains current subsequence
-    int index = 0;
-    string sequence;
+    next->version = ++m_version;
+    const Snapshot* old = m_current.exchange(next);
+    m_cache.clear();
+    m_retired.retire(old);
+}
+
+vector<shared_ptr<GenomeEntry>> GenomeMatcherImpl::makeEntries(const vector<Genome>& genomes) const
+{
+    vector<shared_ptr<GenomeEntry>> entries(genomes.size());
+    for (size_t i = 0; i < genomes.size(); i++)
+        entries[i] = make_shared<GenomeEntry>(genomes[i]);
+    sketchGenomes(entries);
+    return entries;
+}
+
+uint32_t GenomeMatcherImpl::registerEntries(Snapshot& next, const vector<shared_ptr<GenomeEntry>>& entries)
+{
+    // adds entries to next under the next genome IDs and returns the first; called with m_writer
+    // held. A genome re-added under an existing name replaces the old one
     
-    while (genome.extract(index, m_minLength, sequence)) {
-        Pair p;
-        p.first = genome.name();
-        p.second = index;
-        m_library->insert(sequence, p);
-        index++;
+    uint32_t firstId = static_cast<uint32_t>(next.genomes.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        uint32_t id = static_cast<uint32_t>(next.genomes.size());
+        auto old = m_genomeIds.find(entries[i]->name);
+        if (old != m_genomeIds.end()) {
+            m_deadBases += next.genomes[old->second]->genome.length();
+            next.genomes[old->second] = nullptr;
+        }
+        m_genomeIds[entries[i]->name] = id;
+        m_indexedBases += entries[i]->genome.length();
+        next.genomes.push_back(entries[i]);
     }
+    return firstId;
+}
+
+void GenomeMatcherImpl::addEntries(const vector<shared_ptr<GenomeEntry>>& entries)
+{
+    // publishes a snapshot with entries added and indexed in a segment of their own; called
+    // with m_writer held
     
-    if (index < genome.length() && genome.extract(index, genome.length()-index, sequence)) {
-        Pair p;
-        p.first = genome.name();
-        p.second = index;
-        m_library->insert(sequence, p);
+    Snapshot* next = new Snapshot(current());
+    uint32_t firstId = registerEntries(*next, entries);
+    if (m_options.indexMode == MatcherOptions::FM_INDEX) {
+            // a rebuild leaves every removed genome out
+        next->fm = buildFMIndex(*next);
+        m_indexedBases -= m_deadBases;
+        m_deadBases = 0;
+    }
+    else {
+        shared_ptr<Segment> segment = make_shared<Segment>();
+        indexGenomes(*next, firstId, *segment);
+        if (!segment->genomes.empty())
+            next->segments.push_back(segment);
     }
+    publish(next);
 }
 
-int GenomeMatcherImpl::minimumSearchLength() const
+void GenomeMatcherImpl::maybeCompact()
 {
-    return m_minLength;
+    // starts the background compactor if there's something for it to do; called with m_writer held
+    
+    size_t from, to;
+    if (m_compacting || !compactionRange(current(), from, to))
+        return;
+        // a finished compactor has already let go of the lock, so this doesn't wait on us
+    if (m_compactor.joinable())
+        m_compactor.join();
+    m_compacting = true;
+    m_compactor = thread(&GenomeMatcherImpl::compact, this);
 }
 
-bool GenomeMatcherImpl::findGenomesWithThisDNA(const string& fragment, int minimumLength, bool exactMatchOnly, vector<DNAMatch>& matches) const {
-    if (fragment.size() < minimumLength || minimumLength < minimumSearchLength())
+bool GenomeMatcherImpl::compactionRange(const Snapshot& snapshot, size_t& from, size_t& to) const
+{
+    // which segments [from, to) to merge next, false if none. Once removed genomes make up
+    // compactionThreshold of the indexed bases, the one segment holding the most of their
+    // bases, rewritten without their postings (the FM-index is rebuilt whole instead); a
+    // segment at a time until the share is back under the threshold. Otherwise the newest
+    // segments, as long as each one down the line is at most twice the postings of those
+    // after it, so a segment is merged O(log n) times over its life
+    
+    size_t n = snapshot.segments.size();
+    from = 0;
+    to = n;
+    if (m_deadBases > 0 && m_deadBases >= m_options.compactionThreshold * m_indexedBases) {
+        if (m_options.indexMode == MatcherOptions::FM_INDEX)
+            return true;
+        uint64_t most = 0;
+        for (size_t s = 0; s < n; s++) {
+            uint64_t dead = snapshot.deadBases(*snapshot.segments[s]);
+            if (dead > most) {
+                most = dead;
+                from = s;
+            }
+        }
+        if (most > 0) {
+            to = from + 1;
+            return true;
+        }
+        from = 0;
+    }
+    if (n < 2)
         return false;
+    size_t i = n - 1;
+    uint64_t total = snapshot.segments[i]->postingCount;
+    while (i > 0 && snapshot.segments[i - 1]->postingCount <= 2 * total) {
+        i--;
+        total += snapshot.segments[i]->postingCount;
+    }
+    from = i;
+    return i < n - 1;
+}
+
+void GenomeMatcherImpl::compact()
+{
+    // Runs on m_compactor. Takes what to merge from the current snapshot, merges it without the
+    // lock while queries and writers carry on, then publishes the result: the merged segment in
+    // place of its inputs, with whatever segments were added meanwhile after it. Only this
+    // thread replaces segments (writers only append), so the inputs are still where they were.
+    // An FM-index is rebuilt over the live genomes instead, unless a writer already has.
     
-    vector<DNAMatch> m;
-        // string is genome name, vector of <string subsequence, int pos>
-    unordered_map<string, PairVector> results = findGenomesHelper(fragment, minimumLength);
-    
-        // find SNiPs
-    if (!exactMatchOnly) {
-        char bases[5] = { 'A', 'C', 'T', 'G', 'N' };
-        for (int i = 1; i < fragment.size(); i++) {
-            for (int j = 0; j < 5; j++) {
-                string frag = fragment.substr(0, i) + bases[j] + fragment.substr(i+1);
-                if (frag == fragment)
-                    continue;
-                unordered_map<string, PairVector> r = findGenomesHelper(frag, minimumLength);
+    while (true) {
+        Snapshot captured;
+        size_t from, to;
+        uint64_t dead;
+        {
+            lock_guard<mutex> lock(m_writer);
+            if (m_stopCompacting || !compactionRange(current(), from, to)) {
+                m_compacting = false;
+                return;
+            }
+            captured = current();
+            dead = m_deadBases;
+        }
+        
+            // the bases counted dead are only those removed genomes whose postings this drops;
+            // genomes removed since the capture keep theirs
+        if (m_options.indexMode == MatcherOptions::FM_INDEX) {
+            shared_ptr<const FMState> fm = buildFMIndex(captured);
+            lock_guard<mutex> lock(m_writer);
+            if (current().fm != captured.fm)
+                continue;
+            Snapshot* next = new Snapshot(current());
+            next->fm = fm;
+            publish(next);
+            m_deadBases -= dead;
+            m_indexedBases -= dead;
+        }
+        else {
+            uint64_t dropped = 0;
+            for (size_t s = from; s < to; s++)
+                dropped += captured.deadBases(*captured.segments[s]);
+            shared_ptr<Segment> merged = mergeSegments(captured, from, to);
+            lock_guard<mutex> lock(m_writer);
+            const Snapshot& now = current();
+            Snapshot* next = new Snapshot(now);
+            next->segments.assign(now.segments.begin(), now.segments.begin() + from);
+            if (!merged->genomes.empty())
+                next->segments.push_back(merged);
+            next->segments.insert(next->segments.end(), now.segments.begin() + to, now.segments.end());
+            publish(next);
+            m_deadBases -= dropped;
+            m_indexedBases -= dropped;
+        }
+    }
+}
+
+shared_ptr<Segment> GenomeMatcherImpl::mergeSegments(const Snapshot& snapshot, size_t from, size_t to) const
+{
+    // one segment holding the postings of segments [from, to) whose genomes are still live, in
+    // the same (genome ID, position) order: a segment's genomes all come after the previous one's
+    
+    shared_ptr<Segment> merged = make_shared<Segment>();
+    for (size_t s = from; s < to; s++) {
+        const Segment& segment = *snapshot.segments[s];
+        for (const auto& held : segment.genomes)
+            if (!snapshot.isDead(held.first))
+                merged->genomes.push_back(held);
+        merged->trie.mergeFrom(segment.trie, [&](PostingList& list, uint32_t source) {
+            PostingList::const_iterator it, end;
+            segment.postings(source, it, end);
+            for (; it != end; it++)
+                if (!snapshot.isDead(it->genomeId)) {
+                    list.push_back(*it);
+                    merged->postingCount++;
+                }
+        });
+    }
+    merged->trie.prune();
+    return merged;
+}
+
+void GenomeMatcherImpl::indexGenomes(const Snapshot& snapshot, uint32_t firstId, Segment& segment)
+{
+    // indexes every k-mer of genomes firstId onwards into segment (only the minimizers when sampling)
+    
+    vector<const Genome*> genomes;
+    for (uint32_t id = firstId; id < snapshot.genomes.size(); id++)
+        genomes.push_back(snapshot.isDead(id) ? nullptr : &snapshot.genomes[id]->genome);
+    segment.genomes = snapshot.genomesFrom(firstId);
+    encodeKmers(genomes, [&](vector<uint64_t>& records, size_t count) {
+        loadKmers(records, count, firstId, segment);
+    });
+}
+
+void GenomeMatcherImpl::encodeKmers(const vector<const Genome*>& genomes, const function<void(vector<uint64_t>&, size_t)>& sorted) const
+{
+    // encodes the k-mers of genomes (skipping null ones) as packed integers and radix sorts
+    // them, handing sorted(records, count) a run of up to BATCH_WINDOWS at a time; records'
+    // postings hold indices into genomes, and the runs follow them in (index, position) order
+    //
+    // a key is k symbols of 3 bits (ACGTN in trie slot order), SYMBOLS_PER_WORD to a word,
+    // first symbol highest so numeric order is key order; each record is the key words plus
+    // the posting. With bothStrands the key is the lesser of the k-mer and its reverse
+    // complement, and the posting still gives the k-mer's own position
+    
+    const size_t BATCH_WINDOWS = size_t(1) << 22;     // bounds the sort buffers at ~2 x 4M records
+    int k = m_minLength;
+    int keyWords = (k + SYMBOLS_PER_WORD - 1) / SYMBOLS_PER_WORD;
+    int stride = keyWords + 1;
+    
+        // a batch is a list of (genome index, first window, end window) pieces; windows are
+        // taken in (index, position) order across batches, so posting lists stay sorted. When
+        // sampling, window i of a piece is the genome's i-th minimizer rather than position i
+    struct Piece {
+        uint32_t id;
+        int from;
+        int to;
+        const vector<int>* sampled;
+    };
+    vector<Piece> batch;
+    deque<vector<int>> sampled;
+    size_t batchWindows = 0;
+    vector<uint64_t> records;
+    vector<unsigned char> slots;
+    
+    auto flush = [&]() {
+        records.assign(batchWindows * stride, 0);
+        size_t base = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            const Genome* genome = genomes[batch[i].id];
+            int from = batch[i].from, windows = batch[i].to - batch[i].from;
+            const int* positions = batch[i].sampled ? batch[i].sampled->data() : nullptr;
+            int first = positions ? positions[from] : from;
+            int last = positions ? positions[batch[i].to - 1] : batch[i].to - 1;
+            
+                // symbols [first, last + k) of the genome, a packed word at a time
+            slots.resize(size_t(last - first) + k);
+            for (int p = 0; p < static_cast<int>(slots.size()); p += PackedDNA::BASES_PER_WORD) {
+                uint64_t bases, nMask;
+                int n = genome->packedWord(first + p, bases, nMask);
+                for (int j = 0; j < n && p + j < static_cast<int>(slots.size()); j++)
+                    slots[p + j] = ((nMask >> (2 * j)) & 3) ? 4 : ((bases >> (2 * j)) & 3);
+            }
+            
+                // sampled windows are scattered, so each key is built from scratch
+            if (positions != nullptr) {
+                parallelForChunks(windows, 1 << 14, m_workers, [&](int, int begin, int end) {
+                    for (int p = begin; p < end; p++) {
+                        int at = positions[from + p] - first;
+                        for (int w = 0; w < keyWords; w++) {
+                            int offset = w * SYMBOLS_PER_WORD;
+                            int width = min(SYMBOLS_PER_WORD, k - offset);
+                            uint64_t value = 0;
+                            for (int j = 0; j < width; j++)
+                                value = (value << 3) | slots[at + offset + j];
+                            records[(base + p) * stride + w] = value;
+                        }
+                        records[(base + p) * stride + keyWords] = uint64_t(batch[i].id) << 32 | uint32_t(positions[from + p]);
+                    }
+                });
+                base += windows;
+                continue;
+            }
+            
+                // roll each key word along the windows, a chunk of windows per worker
+            parallelForChunks(windows, 1 << 16, m_workers, [&](int, int begin, int end) {
+                for (int w = 0; w < keyWords; w++) {
+                    int offset = w * SYMBOLS_PER_WORD;
+                    int width = min(SYMBOLS_PER_WORD, k - offset);
+                    uint64_t mask = (uint64_t(1) << (3 * width)) - 1;
+                    uint64_t value = 0;
+                    for (int j = 0; j < width - 1; j++)
+                        value = (value << 3) | slots[begin + offset + j];
+                    for (int p = begin; p < end; p++) {
+                        value = ((value << 3) | slots[p + offset + width - 1]) & mask;
+                        records[(base + p) * stride + w] = value;
+                    }
+                }
+                for (int p = begin; p < end; p++)
+                    records[(base + p) * stride + keyWords] = uint64_t(batch[i].id) << 32 | uint32_t(from + p);
+                if (!m_options.bothStrands)
+                    return;
                 
-                    // append resulting map into overarching map
-                for (auto it = r.begin(); it != r.end(); it++) {
-                    pair<string, PairVector> item = *it;
-                    results[item.first].insert(results[item.first].end(), item.second.begin(), item.second.end());
+                    // the reverse complement's words roll the other way: symbol j of window p's
+                    // is the complement of slots[p + k - 1 - j], so the next window's gains a
+                    // new first symbol and drops its last
+                vector<uint64_t> reverse(size_t(end - begin) * keyWords);
+                for (int w = 0; w < keyWords; w++) {
+                    int offset = w * SYMBOLS_PER_WORD;
+                    int width = min(SYMBOLS_PER_WORD, k - offset);
+                    uint64_t value = 0;
+                    for (int j = 0; j < width; j++)
+                        value = (value << 3) | complementSymbol(slots[begin + k - 1 - offset - j]);
+                    for (int p = begin; p < end; p++) {
+                        if (p > begin)
+                            value = (value >> 3) | uint64_t(complementSymbol(slots[p + k - 1 - offset])) << (3 * (width - 1));
+                        reverse[size_t(p - begin) * keyWords + w] = value;
+                    }
+                }
+                for (int p = begin; p < end; p++) {
+                    uint64_t* key = &records[(base + p) * stride];
+                    const uint64_t* other = &reverse[size_t(p - begin) * keyWords];
+                    if (lexicographical_compare(other, other + keyWords, key, key + keyWords))
+                        copy(other, other + keyWords, key);
                 }
+            });
+            base += windows;
+        }
+        
+        radixSortRecords(records, stride, keyWords, m_workers);
+        sorted(records, batchWindows);
+        
+        batch.clear();
+        batchWindows = 0;
+            // the genome being cut up may still have pieces to come
+        while (sampled.size() > 1)
+            sampled.pop_front();
+    };
+    
+    vector<unsigned char> symbols;
+    for (uint32_t id = 0; id < genomes.size(); id++) {
+        const Genome* genome = genomes[id];
+        if (genome == nullptr)
+            continue;
+        int windows = genome->length() - k + 1;
+        const vector<int>* positions = nullptr;
+        if (m_options.indexMode == MatcherOptions::MINIMIZERS) {
+            symbols.resize(max(genome->length(), 0));
+            for (int p = 0; p < genome->length(); p += PackedDNA::BASES_PER_WORD) {
+                uint64_t bases, nMask;
+                int n = genome->packedWord(p, bases, nMask);
+                for (int j = 0; j < n; j++)
+                    symbols[p + j] = ((nMask >> (2 * j)) & 3) ? 4 : ((bases >> (2 * j)) & 3);
             }
+            sampled.push_back(vector<int>());
+            Minimizer::positions(symbols.data(), static_cast<int>(symbols.size()), k, m_options.minimizerWindow, sampled.back());
+            positions = &sampled.back();
+            windows = static_cast<int>(positions->size());
+        }
+        for (int from = 0; from < windows; ) {
+            int to = static_cast<int>(min(size_t(windows), from + (BATCH_WINDOWS - batchWindows)));
+            batch.push_back({id, from, to, positions});
+            batchWindows += to - from;
+            from = to;
+            if (batchWindows == BATCH_WINDOWS)
+                flush();
         }
     }
+    if (batchWindows > 0)
+        flush();
+}
+
+void GenomeMatcherImpl::loadKmers(const vector<uint64_t>& records, size_t count, uint32_t firstId, Segment& segment) const
+{
+    // loads a run from encodeKmers into segment's trie in one pass, its genome indices becoming
+    // IDs from firstId on; runs go in the order encodeKmers made them, so posting lists stay sorted
     
-    for (auto it = results.begin(); it != results.end(); it++) {
-        pair<string, PairVector> item = *it;
-        if (item.second.empty())
-            continue;
-        
-            // find longest match by heapifying all Paris and getting front()
-        make_heap(item.second.begin(), item.second.end(), PairComp);
-        Pair x = item.second.front();
+    int k = m_minLength;
+    int keyWords = (k + SYMBOLS_PER_WORD - 1) / SYMBOLS_PER_WORD;
+    int stride = keyWords + 1;
+    string key(k, 'A');
+    
+        // walk the sorted keys, telling the loader how much of each key the previous one shares
+    Trie<Posting, PostingList>::SortedLoader loader(segment.trie);
+    for (size_t r = 0; r < count; r++) {
+        const uint64_t* record = &records[r * stride];
+        int shared = 0;
+        if (r > 0) {
+            const uint64_t* previous = record - stride;
+            int w = 0;
+            while (w < keyWords && record[w] == previous[w])
+                w++;
+            if (w == keyWords)
+                shared = k;
+            else {
+                int width = min(SYMBOLS_PER_WORD, k - w * SYMBOLS_PER_WORD);
+                int highestDifferingBit = 63 - __builtin_clzll(record[w] ^ previous[w]);
+                shared = w * SYMBOLS_PER_WORD + (3 * width - 1 - highestDifferingBit) / 3;
+            }
+        }
+        for (int t = shared; t < k; t++) {
+            int w = t / SYMBOLS_PER_WORD;
+            int width = min(SYMBOLS_PER_WORD, k - w * SYMBOLS_PER_WORD);
+            key[t] = "ACGTN"[(record[w] >> (3 * (width - 1 - t % SYMBOLS_PER_WORD))) & 7];
+        }
         
-            // create new DNAMatch and add to m, which will become matches
-        DNAMatch toAdd;
-        toAdd.genomeName = item.first;
-        toAdd.length = x.first.size();
-        if (toAdd.length == 0)
+        Posting p;
+        p.genomeId = firstId + uint32_t(record[keyWords] >> 32);
+        p.position = uint32_t(record[keyWords]);
+        loader.add(key, shared, p);
+    }
+    segment.postingCount += count;
+}
+
+void GenomeMatcherImpl::sketchGenomes(vector<shared_ptr<GenomeEntry>>& entries) const
+{
+    // sketches the new entries, a genome per worker at a time
+    
+    if (m_options.sketchScale <= 0)
+        return;
+    int count = static_cast<int>(entries.size());
+    parallelForChunks(count, 1, m_workers, [&](int, int begin, int end) {
+        vector<unsigned char> bases;
+        for (int i = begin; i < end; i++) {
+            vector<uint64_t>& sketch = entries[i]->sketch;
+            symbols(entries[i]->genome, bases);
+            Sketch::sample(bases.data(), static_cast<int>(bases.size()), m_minLength, m_options.sketchScale, sketch, m_options.bothStrands);
+            sort(sketch.begin(), sketch.end());
+            sketch.erase(unique(sketch.begin(), sketch.end()), sketch.end());
+            entries[i]->hashes = sketch.data();
+            entries[i]->hashCount = sketch.size();
+        }
+    });
+}
+
+void GenomeMatcherImpl::symbols(const Genome& genome, vector<unsigned char>& result)
+{
+    // the genome as symbols 0..4 (ACGT, then N), as Minimizer and Sketch take them
+    
+    result.resize(max(genome.length(), 0));
+    for (int p = 0; p < genome.length(); p += PackedDNA::BASES_PER_WORD) {
+        uint64_t bases, nMask;
+        int n = genome.packedWord(p, bases, nMask);
+        for (int j = 0; j < n; j++)
+            result[p + j] = ((nMask >> (2 * j)) & 3) ? 4 : ((bases >> (2 * j)) & 3);
+    }
+}
+
+void GenomeMatcherImpl::containment(const Snapshot& snap, const Genome& query, int fragmentMatchLength, vector<double>& estimates, int& sampled) const
+{
+    // estimates[id] is the estimated share of the k-mers inside query's whole fragments that
+    // live genome id has: the sampled query k-mers are tallied, and every live sketch is
+    // intersected with them
+    
+    int k = m_minLength;
+    int S = query.length()/fragmentMatchLength;
+    vector<unsigned char> bases;
+    symbols(query, bases);
+    vector<uint64_t> hashes;
+    for (int i = 0; i < S; i++)
+        Sketch::sample(bases.data() + size_t(i) * fragmentMatchLength, fragmentMatchLength, k, m_options.sketchScale, hashes, m_options.bothStrands);
+    sampled = static_cast<int>(hashes.size());
+    vector<uint32_t> counts;
+    Sketch::tally(hashes, counts);
+    
+    estimates.assign(snap.genomes.size(), 0);
+    if (sampled == 0)
+        return;
+    for (uint32_t id = 0; id < snap.genomes.size(); id++) {
+        if (snap.isDead(id))
             continue;
-        toAdd.position = x.second;
-        m.push_back(toAdd);
+        const GenomeEntry& entry = *snap.genomes[id];
+        uint64_t found = Sketch::intersect(hashes.data(), counts.data(), hashes.size(), entry.hashes, entry.hashCount);
+        estimates[id] = found / static_cast<double>(sampled);
     }
+}
+
+shared_ptr<const FMState> GenomeMatcherImpl::buildFMIndex(const Snapshot& snapshot) const
+{
+    // an FM-index can't take more text, so every addition rebuilds it over all live genomes
     
-    if (m.empty())
+    shared_ptr<FMState> fm = make_shared<FMState>();
+    vector<unsigned char> text;
+    for (uint32_t id = 0; id < snapshot.genomes.size(); id++) {
+        if (snapshot.isDead(id) || snapshot.genomes[id]->genome.length() == 0)
+            continue;
+        const Genome& genome = snapshot.genomes[id]->genome;
+        fm->starts.push_back(static_cast<uint32_t>(text.size()));
+        fm->ids.push_back(id);
+        for (int p = 0; p < genome.length(); p += PackedDNA::BASES_PER_WORD) {
+            uint64_t bases, nMask;
+            int n = genome.packedWord(p, bases, nMask);
+            for (int j = 0; j < n; j++)
+                text.push_back(((nMask >> (2 * j)) & 3) ? 5 : ((bases >> (2 * j)) & 3) + 1);
+        }
+        text.push_back(FMIndex::SEPARATOR);
+    }
+    fm->index.build(text, m_workers);
+    return fm;
+}
+
+int GenomeMatcherImpl::minimumSearchLength() const
+{
+    return m_minLength;
+}
+
+void GenomeMatcherImpl::setWorkerCount(int workers)
+{
+    m_workers = max(workers, 1);
+}
+
+void GenomeMatcherImpl::setResultCacheSize(size_t bytes)
+{
+    m_cache.setBudget(bytes);
+}
+
+bool GenomeMatcherImpl::findGenomesWithThisDNA(const string& fragment, int minimumLength, bool exactMatchOnly, vector<DNAMatch>& matches) const {
+    Epoch::Guard guard;
+    const Snapshot& snap = current();
+    GENOMICS_SCOPE(scope, m_stats);
+    QueryScratch& scratch = threadScratch();
+    CandidateSet& results = scratch.results;
+    if (!findMatches(snap, fragment, minimumLength, exactMatchOnly, scratch, results))
         return false;
     
-    matches = m;
+    reportMatches(snap, results, matches);
     
-    return true;  // This compiles, but may not be correct
+    return true;
 }
 
-unordered_map<string, PairVector> GenomeMatcherImpl::findGenomesHelper(const string& fragment, int minLength) const {
-    unordered_map<string, PairVector> matches;
-    vector<Pair> potentials = m_library->find(fragment.substr(0, minimumSearchLength()), true);
+bool GenomeMatcherImpl::findGenomesWithThisDNA(const vector<string>& fragments, int minimumLength, bool exactMatchOnly, vector<vector<DNAMatch>>& matches) const {
+    // answers every fragment as the single-fragment call would, but sorts them by their first
+    // minimumSearchLength() bases first: fragments with the same prefix then share one trie
+    // lookup, and in exact mode each lookup resumes from the nodes the previous prefix reached
+    // (unless bothStrands, whose lookups aren't in prefix order)
     
-        // find Genomes with matches of first subsequence of fragment
-    for (int i = 0; i < potentials.size(); i++) {
-        string name = potentials[i].first, extract;
-        int pos = potentials[i].second;
-        if (genomeLibrary.find(name) == genomeLibrary.end())
-            continue;
-        if (genomeLibrary.at(name)->extract(pos, static_cast<int>(fragment.size()), extract)) {
-                // if rest of extract is a match to fragment, add it to map
-            if (isAMatch(extract, fragment, minLength)) {
-                Pair toAdd;
-                toAdd.first = extract;
-                toAdd.second = pos;
-                
-                matches[name].push_back(toAdd);
+    Epoch::Guard guard;
+    const Snapshot& snap = current();
+    matches.assign(fragments.size(), vector<DNAMatch>());
+    if (minimumLength < minimumSearchLength())
+        return false;
+    
+    int k = minimumSearchLength();
+    int mismatches = exactMatchOnly ? 0 : 1;
+    int workers = max(m_workers, 1);
+    vector<char> found(workers, false);
+    
+        // minimizer and FM-index lookups depend on more than the prefix, so each fragment goes on its own
+    if (m_options.indexMode != MatcherOptions::ALL_KMERS) {
+        int count = static_cast<int>(fragments.size());
+        parallelForChunks(count, max(1, count / (workers * 16)), workers, [&](int worker, int begin, int end) {
+            GENOMICS_SCOPE(scope, m_stats);
+            QueryScratch& scratch = threadScratch();
+            CandidateSet& results = scratch.results;
+            for (int i = begin; i < end; i++)
+                if (findMatches(snap, fragments[i], minimumLength, exactMatchOnly, scratch, results)) {
+                    reportMatches(snap, results, matches[i]);
+                    found[worker] = true;
+                }
+        });
+        return find(found.begin(), found.end(), true) != found.end();
+    }
+    
+    vector<int> order;
+    for (int i = 0; i < static_cast<int>(fragments.size()); i++)
+        if (static_cast<int>(fragments[i].size()) >= minimumLength)
+            order.push_back(i);
+    sort(order.begin(), order.end(), [&](int x, int y) {
+        int c = fragments[x].compare(0, k, fragments[y], 0, k);
+        return c != 0 ? c < 0 : x < y;
+    });
+    
+        // groups[g] is where the g-th run of equal prefixes starts in order
+    vector<int> groups;
+    for (int i = 0; i < static_cast<int>(order.size()); i++)
+        if (i == 0 || fragments[order[i]].compare(0, k, fragments[order[i - 1]], 0, k) != 0)
+            groups.push_back(i);
+    groups.push_back(static_cast<int>(order.size()));
+    int groupCount = static_cast<int>(groups.size()) - 1;
+    
+        // a finder per worker per segment, each resuming from its own last prefix
+    size_t segments = snap.segments.size();
+    vector<Trie<Posting, PostingList>::SortedFinder> finders;
+    for (int w = 0; w < workers; w++)
+        for (size_t s = 0; s < segments; s++)
+            finders.push_back(Trie<Posting, PostingList>::SortedFinder(snap.segments[s]->trie));
+    vector<string> lastPrefix(workers);
+    int chunkSize = max(1, groupCount / (workers * 16));
+    
+    parallelForChunks(groupCount, chunkSize, workers, [&](int worker, int begin, int end) {
+        GENOMICS_SCOPE(scope, m_stats);
+        QueryScratch& scratch = threadScratch();
+        CandidateSet& results = scratch.results;
+        string prefix;
+        
+        for (int g = begin; g < end; g++) {
+            const string& first = fragments[order[groups[g]]];
+            prefix.assign(first, 0, k);
+            
+                // one lookup for the whole group, made when the first fragment misses the cache
+            scratch.lists.clear();
+            bool looked = false;
+            auto lookup = [&]() {
+                looked = true;
+                GENOMICS_TIMER(timer, DESCENT_NANOS);
+                int shared = 0;
+                while (shared < k && shared < static_cast<int>(lastPrefix[worker].size()) && prefix[shared] == lastPrefix[worker][shared])
+                    shared++;
+                if (m_options.bothStrands)
+                    prefixKeys(prefix, mismatches, scratch);
+                for (size_t s = 0; s < segments; s++) {
+                    const Segment* segment = snap.segments[s].get();
+                    auto keep = [&](uint32_t list) { scratch.lists.push_back({segment, list, 0}); };
+                    if (m_options.bothStrands)
+                        for (size_t i = 0; i < scratch.keys.size(); i++)
+                            segment->trie.findLists(string_view(scratch.keyText).substr(scratch.keys[i].first, k), scratch.keys[i].second, keep);
+                    else if (mismatches == 0)
+                        finders[worker * segments + s].findList(prefix, shared, keep);
+                    else
+                        segment->trie.findLists(prefix, mismatches, keep);
+                }
+                if (mismatches == 0 && !m_options.bothStrands)
+                    lastPrefix[worker] = prefix;
+            };
+            
+            for (int i = groups[g]; i < groups[g + 1]; i++) {
+                GENOMICS_COUNT(QUERIES, 1);
+                results.reset(snap.genomes.size());
+                if (!cachedMatches(snap, fragments[order[i]], minimumLength, exactMatchOnly, scratch, results)) {
+                    if (!looked)
+                        lookup();
+                    GENOMICS_TIMER(timer, VERIFY_NANOS);
+                    findGenomesHelper(snap, fragments[order[i]], minimumLength, mismatches, scratch, results);
+                    cacheMatches(scratch, results);
+                }
+                if (!results.empty()) {
+                    reportMatches(snap, results, matches[order[i]]);
+                    found[worker] = true;
+                }
             }
         }
-    }
+    });
+    
+    return find(found.begin(), found.end(), true) != found.end();
+}
+
+void GenomeMatcherImpl::reportMatches(const Snapshot& snap, CandidateSet& results, vector<DNAMatch>& matches) const {
+    // report genomes in the order they were added, filling in matches' existing entries so a
+    // caller reusing the vector reuses their storage. Entries it sheds leave their names'
+    // buffers with this thread, and entries it grows take them back, so a name too long for
+    // the string's own buffer isn't allocated again each time the vector grows
     
-        // set vector to contain only largest match
-    for (auto it = matches.begin(); it != matches.end(); it++) {
-        pair<string, PairVector> item = *it;
-        make_heap(item.second.begin(), item.second.end(), PairComp);
-        Pair longest = item.second.front();
-        item.second.clear();
-        item.second.push_back(longest);
+    sort(results.ids.begin(), results.ids.end());
+    vector<string>& names = threadScratch().names;
+    size_t had = matches.size();
+    for (size_t i = results.ids.size(); i < had; i++)
+        names.push_back(move(matches[i].genomeName));
+    matches.resize(results.ids.size());
+    for (size_t i = had; i < matches.size() && !names.empty(); i++) {
+        matches[i].genomeName.swap(names.back());
+        names.pop_back();
+    }
+    for (size_t i = 0; i < results.ids.size(); i++) {
+        uint32_t id = results.ids[i];
+        matches[i].genomeName.assign(snap.genomes[id]->name);
+        matches[i].length = results.best[id].length;
+        matches[i].position = results.best[id].position;
+        matches[i].reverseStrand = results.best[id].reverse;
     }
+}
+
+QueryScratch& GenomeMatcherImpl::threadScratch() {
+    // the calling thread's scratch, shared by every matcher it queries; a query only holds it
+    // for the length of the call
     
-    return matches;
+    thread_local QueryScratch scratch;
+    scratch.only = nullptr;
+    return scratch;
 }
 
-bool GenomeMatcherImpl::isAMatch(string& sequence, const string& fragment, int minLength) const {
-    // return true if sequence is longer than minLength and ALSO matches with fragment, modifying sequence appropriately
+bool GenomeMatcherImpl::findMatches(const Snapshot& snap, const string& fragment, int minimumLength, bool exactMatchOnly, QueryScratch& scratch, CandidateSet& results) const {
+    // fills results with the best match per genome ID of snap; false if nothing matched
     
-        // if sequence is equal to fragment, then true
-    if (sequence == fragment)
-        return true;
+    GENOMICS_COUNT(QUERIES, 1);
+    results.reset(snap.genomes.size());
+    if (static_cast<int>(fragment.size()) < minimumLength || minimumLength < minimumSearchLength())
+        return false;
     
-    int length = static_cast<int>(fragment.size())-1;
-    for (int i = length; i >= minLength; i--) {
-            // if some subsequence of sequence is equal to the same subsequence of fragment, then true
-        if (sequence.substr(0, i) == fragment.substr(0, i)) {
-            sequence = sequence.substr(0, i);
-            return true;
+        // one trie descent covers the exact matches and, with a mismatch to spend, every SNiP of the prefix
+    if (cachedMatches(snap, fragment, minimumLength, exactMatchOnly, scratch, results))
+        return !results.empty();
+    int mismatches = exactMatchOnly ? 0 : 1;
+    if (snap.fm != nullptr) {
+        findWithFMIndex(snap, fragment, minimumLength, mismatches, scratch, results);
+        cacheMatches(scratch, results);
+        return !results.empty();
+    }
+    if (m_options.indexMode == MatcherOptions::MINIMIZERS) {
+        scratch.lists.clear();
+        {
+            GENOMICS_TIMER(timer, DESCENT_NANOS);
+            minimizerLookups(snap, fragment, mismatches, scratch);
+        }
+        GENOMICS_TIMER(timer, VERIFY_NANOS);
+        findGenomesHelper(snap, fragment, minimumLength, mismatches, scratch, results);
+    }
+    else {
+            // verify each list as the descent reaches it, so the descent can stop as soon as
+            // nothing more is needed
+        GENOMICS_TIMER(timer, VERIFY_NANOS);
+        pack(fragment, scratch.fragment);
+        prefixKeys(string_view(fragment).substr(0, minimumSearchLength()), mismatches, scratch);
+        string_view text(scratch.keyText);
+        bool more = true;
+        for (size_t s = 0; more && s < snap.segments.size(); s++) {
+            const Segment& segment = *snap.segments[s];
+            for (size_t i = 0; more && i < scratch.keys.size(); i++)
+                more = segment.trie.findLists(text.substr(scratch.keys[i].first, minimumSearchLength()), scratch.keys[i].second, [&](uint32_t list) {
+                    return checkPostings(snap, segment, list, 0, minimumLength, mismatches, scratch, results);
+                });
         }
     }
+    cacheMatches(scratch, results);
     
-    return false;
+    return !results.empty();
 }
 
-bool GenomeMatcherImpl::PairComp(Pair x, Pair y) {
-    // if true, x should be before/less than y
+bool GenomeMatcherImpl::cachedMatches(const Snapshot& snap, const string& fragment, int minimumLength, bool exactMatchOnly, QueryScratch& scratch, CandidateSet& results) const {
+    // fills results from the cache if it holds this query; either way leaves its key in scratch
+    // for cacheMatches. The key is the snapshot version, the fragment's length, minimumLength and
+    // the mode, then the fragment packed 2 bits a base with its N mask. Characters other than ACGTN get no key: they look up
+    // differently from N but would pack the same
+    
+    scratch.cacheKey.clear();
+    if (!m_cache.enabled())
+        return false;
+    for (size_t i = 0; i < fragment.size(); i++)
+        if (PackedDNA::baseCode(fragment[i]) < 0 && fragment[i] != 'N' && fragment[i] != 'n')
+            return false;
     
-        // if length of x's extract is longer than length of y
-    if (x.first.size() > y.first.size())
+    pack(fragment, scratch.fragment);
+    int32_t header[3] = { static_cast<int32_t>(fragment.size()), minimumLength, exactMatchOnly };
+    scratch.cacheKey.append(reinterpret_cast<const char*>(&snap.version), sizeof(snap.version));
+    scratch.cacheKey.append(reinterpret_cast<const char*>(header), sizeof(header));
+    scratch.cacheKey.append(reinterpret_cast<const char*>(scratch.fragment.bases.data()), scratch.fragment.bases.size() * sizeof(uint64_t));
+    scratch.cacheKey.append(reinterpret_cast<const char*>(scratch.fragment.nMask.data()), scratch.fragment.nMask.size() * sizeof(uint64_t));
+        // a lookup restricted to some genomes is never cached, so its miss isn't counted
+    if (!m_cache.get(scratch.cacheKey, scratch.cached, scratch.only == nullptr))
         return false;
+    for (size_t i = 0; i < scratch.cached.size(); i++)
+        keepBest(scratch.cached[i].first, scratch.cached[i].second, results);
+    return true;
+}
+
+void GenomeMatcherImpl::cacheMatches(QueryScratch& scratch, const CandidateSet& results) const {
+        // results restricted to some genomes aren't the whole answer
+    if (scratch.cacheKey.empty() || scratch.only != nullptr)
+        return;
+    scratch.cached.clear();
+    for (uint32_t id : results.ids)
+        scratch.cached.push_back(make_pair(id, results.best[id]));
+    m_cache.put(scratch.cacheKey, scratch.cached, scratch.cached.size() * sizeof(scratch.cached[0]));
+}
+
+void GenomeMatcherImpl::minimizerLookups(const Snapshot& snap, const string& fragment, int mismatches, QueryScratch& scratch) const {
+    // fills scratch.lists from a minimizer-sampled index: a genome matching the fragment's first
+    // window of k + w - 1 bases has the window's minimizer indexed at the same offset. With a
+    // mismatch to spend, the genome's window may differ from the fragment's in any one base
+    // after the first, so every such variant's minimizer is looked up as well
+    
+    int k = m_minLength;
+    
+        // mirror what a prefix lookup accepts: a character the trie has no slot for can't match
+        // exactly, and in SNP mode can only stand in for the one mismatch after the first base
+    int invalid = 0;
+    for (int i = 0; i < k; i++)
+        if (PackedDNA::baseCode(fragment[i]) < 0 && fragment[i] != 'N' && fragment[i] != 'n') {
+            if (i == 0)
+                return;
+            invalid++;
+        }
+    if (invalid > mismatches)
+        return;
+    
+    int count = static_cast<int>(min(fragment.size(), size_t(k + m_options.minimizerWindow - 1)));
+    int kmers = count - k + 1;
+    scratch.symbols.resize(count);
+    for (int i = 0; i < count; i++)
+        scratch.symbols[i] = static_cast<unsigned char>(Minimizer::symbol(fragment[i]));
+    Minimizer::powers(k, scratch.powers);
+    Minimizer::rawValues(scratch.symbols.data(), count, k, scratch.powers, scratch.values);
+    
+        // the minimizer of the window with base x replaced by symbol c (x < 0: as it is)
+    auto addMinimizer = [&](int x, int c) {
+        int best = 0;
+        uint64_t bestHash = 0;
+        for (int start = 0; start < kmers; start++) {
+            uint64_t value = scratch.values[start];
+            if (x >= start && x < start + k)
+                value += (uint64_t(c) - scratch.symbols[x]) * scratch.powers[k - 1 - (x - start)];
+            uint64_t hash = Minimizer::mix(value);
+            if (start == 0 || hash < bestHash) {
+                best = start;
+                bestHash = hash;
+            }
+        }
+        int at = static_cast<int>(scratch.keyText.size());
+        for (int i = 0; i < k; i++)
+            scratch.keyText.push_back("ACGTN"[best + i == x ? c : scratch.symbols[best + i]]);
+        scratch.keys.push_back(make_pair(at, best));
+    };
+    
+    scratch.keyText.clear();
+    scratch.keys.clear();
+    addMinimizer(-1, 0);
+    if (mismatches > 0)
+        for (int x = 1; x < count; x++)
+            for (int c = 0; c < 5; c++)
+                if (c != scratch.symbols[x])
+                    addMinimizer(x, c);
+    string_view text(scratch.keyText);
+    auto key = [&](const pair<int, int>& entry) { return make_pair(text.substr(entry.first, k), entry.second); };
+    sort(scratch.keys.begin(), scratch.keys.end(), [&](const pair<int, int>& x, const pair<int, int>& y) { return key(x) < key(y); });
+    scratch.keys.erase(unique(scratch.keys.begin(), scratch.keys.end(), [&](const pair<int, int>& x, const pair<int, int>& y) { return key(x) == key(y); }), scratch.keys.end());
     
-        // if lengths are equal, and x's starting position is earlier than y's
-    if (x.first.size() == y.first.size() && x.second < y.second)
+    for (size_t s = 0; s < snap.segments.size(); s++) {
+        const Segment* segment = snap.segments[s].get();
+        for (size_t i = 0; i < scratch.keys.size(); i++) {
+            int offset = scratch.keys[i].second;
+            segment->trie.findLists(key(scratch.keys[i]).first, 0, [&](uint32_t list) {
+                scratch.lists.push_back({segment, list, offset});
+            });
+        }
+    }
+}
+
+void GenomeMatcherImpl::prefixKeys(string_view prefix, int mismatches, QueryScratch& scratch) const {
+    // fills scratch.keys with the trie lookups that find a fragment's k-base prefix: just the
+    // prefix, with the fragment's mismatches, unless bothStrands. Then a k-mer is indexed under
+    // the lesser of itself and its reverse complement, so the prefix's k-mer may be under
+    // either: exactly, that's one lookup of the lesser. With a SNiP to spend, the prefix's own
+    // SNiPs are anywhere after its first base, which is anywhere in the reverse complement but
+    // its last base; so that is looked up with a mismatch, and once with each other first base
+    //
+    // a first base the trie has no slot for can't match, on either strand
+    
+    int k = m_minLength;
+    scratch.keyText.assign(prefix);
+    scratch.keys.clear();
+    if (!m_options.bothStrands) {
+        scratch.keys.push_back(make_pair(0, mismatches));
+        return;
+    }
+    if (PackedDNA::baseCode(prefix[0]) < 0 && prefix[0] != 'N' && prefix[0] != 'n')
+        return;
+    
+        // the reverse complement; a character without a complement stays, and still can't match
+    for (int i = k - 1; i >= 0; i--) {
+        int code = PackedDNA::baseCode(prefix[i]);
+        scratch.keyText.push_back(code >= 0 ? PackedDNA::codeBase(3 - code) : (prefix[i] == 'n' ? 'N' : prefix[i]));
+    }
+    if (mismatches == 0) {
+        auto slot = [](char c) { int code = PackedDNA::baseCode(c); return code >= 0 ? code : 4; };
+        int i = 0;
+        while (i < k && slot(scratch.keyText[k + i]) == slot(scratch.keyText[i]))
+            i++;
+        scratch.keys.push_back(make_pair(i < k && slot(scratch.keyText[k + i]) < slot(scratch.keyText[i]) ? k : 0, 0));
+        return;
+    }
+    scratch.keys.push_back(make_pair(0, mismatches));
+    scratch.keys.push_back(make_pair(k, mismatches));
+    for (int c = 0; c < 5; c++)
+        if ("ACGTN"[c] != scratch.keyText[k]) {
+            scratch.keys.push_back(make_pair(static_cast<int>(scratch.keyText.size()), 0));
+            scratch.keyText.push_back("ACGTN"[c]);
+            scratch.keyText.append(scratch.keyText, k + 1, k - 1);
+        }
+}
+
+void GenomeMatcherImpl::findGenomesHelper(const Snapshot& snap, const string& fragment, int minLength, int mismatches, QueryScratch& scratch, CandidateSet& matches) const {
+    // checks fragment against every posting in scratch.lists, keeping each genome's best match in matches
+    
+    pack(fragment, scratch.fragment);
+    for (size_t l = 0; l < scratch.lists.size(); l++)
+        if (!checkPostings(snap, *scratch.lists[l].segment, scratch.lists[l].list, scratch.lists[l].offset, minLength, mismatches, scratch, matches))
+            return;
+}
+
+bool GenomeMatcherImpl::checkPostings(const Snapshot& snap, const Segment& segment, uint32_t list, int offset, int minLength, int mismatches, QueryScratch& scratch, CandidateSet& matches) const {
+    // checks the fragment packed in scratch against one of segment's posting lists, read in
+    // place; false once the query needs nothing more, so the caller can stop handing it lists
+    
+    PostingList::const_iterator it, end;
+    segment.postings(list, it, end);
+    for (; it != end; it++) {
+        GENOMICS_COUNT(POSTINGS, 1);
+        int pos = static_cast<int>(it->position) - offset;
+        if (m_options.bothStrands) {
+                // the k-mer may be the prefix read along either strand; read against the genome's,
+                // the fragment ends at the k-mer's last base
+            int start = pos + m_minLength - scratch.fragment.length;
+            if (settled(snap, it->genomeId, min(pos, start), scratch, matches))
+                continue;
+            checkCandidate(snap, it->genomeId, pos, false, minLength, mismatches, scratch, matches);
+            checkCandidate(snap, it->genomeId, start, true, minLength, mismatches, scratch, matches);
+        }
+        else {
+            if (pos < 0 || settled(snap, it->genomeId, pos, scratch, matches))
+                continue;
+            checkCandidate(snap, it->genomeId, pos, false, minLength, mismatches, scratch, matches);
+        }
+        if (scratch.only != nullptr && matches.ids.size() >= scratch.wanted)
+            return false;
+    }
+    return true;
+}
+
+bool GenomeMatcherImpl::settled(const Snapshot& snap, uint32_t id, int pos, const QueryScratch& scratch, const CandidateSet& matches) const {
+    // true if checking genome id at pos can't change the answer: the genome is gone or not
+    // wanted, or already has a match this one can't beat, i.e. the whole fragment no later
+    // (and if at pos, on the forward strand)
+    
+    if (snap.isDead(id) || (scratch.only != nullptr && !(*scratch.only)[id]))
+        return true;
+    const Candidate& best = matches.best[id];
+    if (best.length < 0)
         return false;
+    return scratch.only != nullptr || (best.length == scratch.fragment.length && (best.position < pos || (best.position == pos && !best.reverse)));
+}
+
+void GenomeMatcherImpl::findWithFMIndex(const Snapshot& snap, const string& fragment, int minLength, int mismatches, QueryScratch& scratch, CandidateSet& matches) const {
+    // backward search for the fragment's first minLength bases (the whole of them, not just a
+    // k-mer), allowing the SNiP through backtracking, then locate each occurrence
+    //
+    // a character the trie has no slot for can't be in a prefix lookup, so within the first
+    // minimumSearchLength() it only matches by substitution; past that, verification reads it
+    // as N, so it searches as N
     
+    int k = minimumSearchLength();
+    const FMState& fm = *snap.fm;
+    scratch.symbols.resize(minLength);
+    for (int i = 0; i < minLength; i++) {
+        char c = fragment[i];
+        int code = PackedDNA::baseCode(c);
+        if (code >= 0)
+            scratch.symbols[i] = static_cast<unsigned char>(code + 1);
+        else
+            scratch.symbols[i] = (c == 'N' || c == 'n' || i >= k) ? 5 : FMIndex::SYMBOLS;
+    }
+    
+    scratch.positions.clear();
+    {
+        GENOMICS_TIMER(timer, DESCENT_NANOS);
+        fm.index.search(scratch.symbols.data(), minLength, mismatches, [&](FMIndex::Range range) {
+            for (uint32_t row = range.begin; row < range.end; row++)
+                scratch.positions.push_back(fm.index.locate(row));
+        });
+    }
+    
+        // when the fragment is no longer than the search, every occurrence is a whole match
+    bool whole = static_cast<int>(fragment.size()) == minLength;
+    if (whole)
+        scratch.fragment.length = minLength;    // all settled() reads of it
+    else
+        pack(fragment, scratch.fragment);
+    for (size_t i = 0; i < scratch.positions.size(); i++) {
+        GENOMICS_COUNT(POSTINGS, 1);
+        uint32_t at = scratch.positions[i];
+        int g = static_cast<int>(upper_bound(fm.starts.begin(), fm.starts.end(), at) - fm.starts.begin()) - 1;
+        int pos = static_cast<int>(at - fm.starts[g]);
+        if (settled(snap, fm.ids[g], pos, scratch, matches))
+            continue;
+        if (whole) {
+            GENOMICS_COUNT(ACCEPTED, 1);
+            keepBest(fm.ids[g], Candidate{ minLength, pos, false }, matches);
+        }
+        else
+            checkCandidate(snap, fm.ids[g], pos, false, minLength, mismatches, scratch, matches);
+        if (scratch.only != nullptr && matches.ids.size() >= scratch.wanted)
+            break;
+    }
+}
+
+void GenomeMatcherImpl::checkCandidate(const Snapshot& snap, uint32_t id, int pos, bool reverse, int minLength, int mismatches, QueryScratch& scratch, CandidateSet& matches) const {
+    // compares genome id at pos against the fragment packed in scratch, keeping it in matches if
+    // it matches for minLength bases and beats the genome's best so far. If reverse, it's the
+    // reverse complement of the fragment-long window at pos that is compared, and a match runs
+    // back from the window's end
+    
+    int length;
+    if (snap.isDead(id) || !pack(snap.genomes[id]->genome, pos, scratch.fragment.length, scratch.window))
+        return;
+    if (reverse)
+        PackedDNA::reverseComplement(scratch.window.bases.data(), scratch.window.nMask.data(), scratch.window.length);
+    GENOMICS_COUNT(VERIFIED, 1);
+    if (isAMatch(scratch.window, scratch.fragment, minLength, mismatches, length)) {
+        GENOMICS_COUNT(ACCEPTED, 1);
+        keepBest(id, Candidate{ length, reverse ? pos + scratch.fragment.length - length : pos, reverse }, matches);
+    }
+}
+
+void GenomeMatcherImpl::keepBest(uint32_t id, const Candidate& candidate, CandidateSet& matches) {
+    Candidate& best = matches.best[id];
+    if (best.length < 0)
+        matches.ids.push_back(id);
+    if (best.length < 0 || isBetter(candidate, best))
+        best = candidate;
+}
+
+bool GenomeMatcherImpl::isAMatch(const PackedBases& sequence, const PackedBases& fragment, int minLength, int mismatches, int& length) const {
+    // return true if sequence matches fragment for at least minLength bases, setting length to how far it matches
+    // up to mismatches bases after the first may differ; the match ends just before the one that would exceed that
+    
+    int size = fragment.length;
+    length = PackedDNA::firstDifference(sequence.bases.data(), sequence.nMask.data(), fragment.bases.data(), fragment.nMask.data(), 0, size);
+    while (length > 0 && length < size && mismatches-- > 0)
+        length = PackedDNA::firstDifference(sequence.bases.data(), sequence.nMask.data(), fragment.bases.data(), fragment.nMask.data(), length + 1, size);
+    
+    return length >= minLength;
+}
+
+void GenomeMatcherImpl::pack(const string& fragment, PackedBases& packed) {
+    packed.length = static_cast<int>(fragment.size());
+    packed.bases.resize(PackedDNA::wordsFor(packed.length));
+    packed.nMask.resize(packed.bases.size());
+    for (size_t w = 0; w < packed.bases.size(); w++)
+        PackedDNA::packWord(fragment, w * PackedDNA::BASES_PER_WORD, packed.bases[w], packed.nMask[w]);
+}
+
+bool GenomeMatcherImpl::pack(const Genome& genome, int position, int length, PackedBases& packed) {
+    // the same as extract, but packed; false if [position, position+length) runs off the genome
+    
+    if (position < 0 || length < 0 || position + length > genome.length())
+        return false;
+    packed.length = length;
+    packed.bases.resize(PackedDNA::wordsFor(length));
+    packed.nMask.resize(packed.bases.size());
+    GENOMICS_COUNT(EXTRACT_CALLS, 1);
+    GENOMICS_COUNT(EXTRACT_BYTES, packed.bases.size() * 2 * sizeof(uint64_t));
+    for (int w = 0; w < static_cast<int>(packed.bases.size()); w++)
+        genome.packedWord(position + w * PackedDNA::BASES_PER_WORD, packed.bases[w], packed.nMask[w]);
+    if (!packed.bases.empty()) {
+        packed.bases.back() &= PackedDNA::lowBases(length - (int(packed.bases.size()) - 1) * PackedDNA::BASES_PER_WORD);
+        packed.nMask.back() &= PackedDNA::lowBases(length - (int(packed.nMask.size()) - 1) * PackedDNA::BASES_PER_WORD);
+    }
     return true;
 }
 
+bool GenomeMatcherImpl::isBetter(const Candidate& x, const Candidate& y) {
+    // true if x should replace y: longer match, or same length and earlier position, or the
+    // same but on the forward strand
+    
+    if (x.length != y.length)
+        return x.length > y.length;
+    if (x.position != y.position)
+        return x.position < y.position;
+    return !x.reverse && y.reverse;
+}
+
 bool GenomeMatcherImpl::findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, vector<GenomeMatch>& results) const {
+        // with no limit on results only the threshold can rule genomes out early
+    return findRelatedGenomes(query, fragmentMatchLength, exactMatchOnly, matchPercentThreshold, 0, results);
+}
+
+bool GenomeMatcherImpl::findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, int maxResults, vector<GenomeMatch>& results) const {
+    // the first maxResults (all if maxResults <= 0) of the genomes whose fragments match
+    // often enough. Fragments go in rounds; after each, a genome is dropped once matching every
+    // fragment still to come couldn't lift it to the threshold or to the maxResults-th best
+    // count so far, and dropped genomes' candidates aren't verified again. Once nothing more
+    // can be dropped, the remaining fragments go in a single pass. Survivors are counted over
+    // every fragment, so their percentages are exact
     
     if (query.length() < fragmentMatchLength || fragmentMatchLength < minimumSearchLength())
         return false;
     
-        // string for Genome name, int for number of S matches
-    unordered_map<string, int> matches;
+    Epoch::Guard guard;
+    const Snapshot& snap = current();
     int S = query.length()/fragmentMatchLength;
     
-        // for all sequences of length fragmentMatchLength
-    for (int i = 0; i < S; i++) {
-        vector<DNAMatch> m;
-        string fragment;
-        query.extract(i*fragmentMatchLength, fragmentMatchLength, fragment);
+        // fewest matching fragments that pass the threshold, tested as percentages are below
+    int needed = 1;
+    while (needed <= S && needed/static_cast<double>(S) * 100 < matchPercentThreshold)
+        needed++;
+    if (needed > S)
+        return false;
+    
+    vector<char> alive(snap.genomes.size(), false);
+    vector<uint32_t> candidates;
+    for (uint32_t id = 0; id < snap.genomes.size(); id++)
+        if (!snap.isDead(id)) {
+            alive[id] = true;
+            candidates.push_back(id);
+        }
+    
+        // With sketches, rule out up front the genomes whose estimated containment is well below
+        // what the threshold takes. An exactly matching fragment puts all of its k-mers in the
+        // genome, and one with a SNiP at least all but k of them, so the fraction of fragment
+        // k-mers found bounds the fraction of fragments matching; the sketch only estimates that
+        // fraction, hence the margin of four standard errors
+    int k = minimumSearchLength();
+    double share = exactMatchOnly ? 1.0 : (fragmentMatchLength >= 2 * k ? double(fragmentMatchLength - 2 * k + 1) / (fragmentMatchLength - k + 1) : 0.0);
+    if (m_options.sketchScale > 0 && matchPercentThreshold > 0 && share > 0) {
+        vector<double> estimates;
+        int sampled;
+        containment(snap, query, fragmentMatchLength, estimates, sampled);
+        double floor = min(matchPercentThreshold, 100.0) / 100 * share;
+        double margin = 4 * sqrt(floor * (1 - floor) / max(sampled, 1)) + 1.0 / max(sampled, 1);
+        size_t kept = 0;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (sampled == 0 || estimates[candidates[i]] + margin >= floor)
+                candidates[kept++] = candidates[i];
+            else
+                alive[candidates[i]] = false;
+        }
+        candidates.resize(kept);
+    }
+    
+    int workers = max(m_workers, 1);
+    int round = max(256, workers * 64);
+    vector<int> totals(snap.genomes.size(), 0);
+    vector<vector<int>> counts(workers, vector<int>(snap.genomes.size(), 0));
+    vector<int> best;
+    bool decided = false;
+    for (int done = 0; done < S && !candidates.empty(); ) {
+        int n = decided ? S - done : min(round, S - done);
+        parallelForChunks(n, max(1, n / (workers * 16)), workers, [&](int worker, int begin, int end) {
+            GENOMICS_SCOPE(scope, m_stats);
+            QueryScratch& scratch = threadScratch();
+            scratch.only = &alive;
+            scratch.wanted = candidates.size();
+            for (int i = done + begin; i < done + end; i++) {
+                query.extract(i*fragmentMatchLength, fragmentMatchLength, scratch.text);
+                if (!findMatches(snap, scratch.text, fragmentMatchLength, exactMatchOnly, scratch, scratch.results))
+                    continue;
+                for (uint32_t id : scratch.results.ids)
+                    counts[worker][id]++;
+            }
+            scratch.only = nullptr;
+        });
+        done += n;
         
-            // find genome names that have matches
-        if (!findGenomesWithThisDNA(fragment, fragmentMatchLength, exactMatchOnly, m))
-            continue;
+        for (size_t i = 0; i < candidates.size(); i++)
+            for (int w = 0; w < workers; w++) {
+                totals[candidates[i]] += counts[w][candidates[i]];
+                counts[w][candidates[i]] = 0;
+            }
         
-            // if match, increase count in matches
-        for (int i = 0; i < m.size();i++) {
-            matches[m[i].genomeName] ++;
+            // the maxResults best counts so far are a floor for the final ones
+        int cut = needed;
+        if (maxResults > 0 && candidates.size() > size_t(maxResults)) {
+            best.clear();
+            for (size_t i = 0; i < candidates.size(); i++)
+                best.push_back(totals[candidates[i]]);
+            nth_element(best.begin(), best.begin() + (maxResults - 1), best.end(), greater<int>());
+            cut = max(cut, best[maxResults - 1]);
+        }
+        int remaining = S - done;
+        size_t kept = 0;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (totals[candidates[i]] + remaining >= cut)
+                candidates[kept++] = candidates[i];
+            else
+                alive[candidates[i]] = false;
         }
+        candidates.resize(kept);
+        
+            // once every survivor has the threshold's count and they fit in maxResults, none can
+            // be dropped any more: the rest of the fragments only add to their counts, so they go
+            // in one pass instead of rounds
+        decided = maxResults <= 0 || candidates.size() <= size_t(maxResults);
+        for (size_t i = 0; decided && i < candidates.size(); i++)
+            decided = totals[candidates[i]] >= needed;
     }
     
     vector<GenomeMatch> percentages;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (totals[candidates[i]] < needed)
+            continue;
+        GenomeMatch m;
+        m.genomeName = snap.genomes[candidates[i]]->name;
+        m.percentMatch = totals[candidates[i]]/static_cast<double>(S) * 100;
+        percentages.push_back(m);
+    }
+    if (percentages.empty())
+        return false;
+    
+    sort(percentages.begin(), percentages.end(), sortGenomeMatch);
+    if (maxResults > 0 && percentages.size() > size_t(maxResults))
+        percentages.resize(maxResults);
+    results = percentages;
     
-        // for all matched genomes, calculate percentage
-    for (auto it = matches.begin(); it != matches.end(); it++) {
+    return true;
+}
+
+bool GenomeMatcherImpl::estimateRelatedGenomes(const Genome& query, int fragmentMatchLength, double matchPercentThreshold, vector<GenomeMatch>& results) const {
+    if (m_options.sketchScale <= 0 || query.length() < fragmentMatchLength || fragmentMatchLength < minimumSearchLength())
+        return false;
+    
+    Epoch::Guard guard;
+    const Snapshot& snap = current();
+    vector<double> estimates;
+    int sampled;
+    containment(snap, query, fragmentMatchLength, estimates, sampled);
+    
+    vector<GenomeMatch> percentages;
+    for (uint32_t id = 0; id < estimates.size(); id++) {
+        if (estimates[id] == 0)
+            continue;
         GenomeMatch m;
-        m.genomeName = (*it).first;
-        m.percentMatch = (*it).second/static_cast<double>(S) * 100;
-        
-            // if percentage is above threshold, push into percentages
+        m.genomeName = snap.genomes[id]->name;
+        m.percentMatch = estimates[id] * 100;
         if (m.percentMatch >= matchPercentThreshold)
             percentages.push_back(m);
     }
-    
     if (percentages.empty())
         return false;
     
@@ -257,6 +1695,300 @@ bool GenomeMatcherImpl::sortGenomeMatch(GenomeMatch x, GenomeMatch y) {
     return false;
 }
 
+bool GenomeMatcherImpl::save(const string& path) const {
+    // writes the library in the IndexFile.h layout, then maps the result to fill in the checksums
+    
+    using namespace IndexFile;
+    Epoch::Guard guard;
+    const Snapshot& snap = current();
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out)
+        return false;
+    
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = INDEX_VERSION;
+    header.minSearchLength = m_minLength;
+    header.indexMode = m_options.indexMode;
+    header.minimizerWindow = m_options.minimizerWindow;
+    header.sketchScale = max(m_options.sketchScale, 0);
+    header.bothStrands = m_options.bothStrands;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    
+    auto pad = [&out]() {
+        while (out.tellp() % 8 != 0)
+            out.put('\0');
+    };
+    
+        // genome table, then each genome's packed block
+    header.genomeCount = snap.genomes.size();
+    header.genomeTable = out.tellp();
+    vector<uint64_t> blocks(snap.genomes.size(), 0);
+    out.write(reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(uint64_t));
+    for (uint32_t id = 0; id < snap.genomes.size(); id++) {
+        if (snap.isDead(id))
+            continue;
+        blocks[id] = out.tellp();
+        snap.genomes[id]->genome.writePacked(out);
+    }
+    
+        // the file holds one trie, so several segments are merged into one first
+    shared_ptr<const Segment> segment;
+    if (snap.segments.size() == 1)
+        segment = snap.segments[0];
+    else
+        segment = mergeSegments(snap, 0, snap.segments.size());
+    
+        // trie nodes as they sit in memory
+    header.nodeCount = segment->trie.nodeCount();
+    header.nodes = out.tellp();
+    out.write(static_cast<const char*>(segment->trie.nodeData()), header.nodeCount * Trie<Posting, PostingList>::NODE_BYTES);
+    pad();
+    
+        // where each posting list sits in the pool, then the pool itself
+    header.listCount = segment->listCount();
+    header.lists = out.tellp();
+    vector<IndexList> lists(header.listCount);
+    vector<pair<const unsigned char*, size_t>> bytes(header.listCount);
+    uint64_t poolBytes = 0;
+    for (uint32_t i = 0; i < header.listCount; i++) {
+        if (segment->mappedLists != nullptr)
+            bytes[i] = make_pair(segment->mappedPool + segment->mappedLists[i].offset, size_t(segment->mappedLists[i].bytes));
+        else
+            bytes[i] = make_pair(segment->trie.values(i).data(), segment->trie.values(i).bytes());
+        lists[i].offset = poolBytes;
+        lists[i].bytes = bytes[i].second;
+        poolBytes += bytes[i].second;
+    }
+    out.write(reinterpret_cast<const char*>(lists.data()), lists.size() * sizeof(IndexList));
+    header.pool = out.tellp();
+    header.poolBytes = poolBytes;
+    for (uint32_t i = 0; i < header.listCount; i++)
+        out.write(reinterpret_cast<const char*>(bytes[i].first), bytes[i].second);
+    pad();
+    
+        // where each genome's sketch starts among the hashes (removed genomes have none), then the hashes
+    header.sketchTable = out.tellp();
+    header.sketchHashes = 0;
+    if (header.sketchScale > 0) {
+        vector<uint64_t> starts(1, 0);
+        for (uint32_t id = 0; id < snap.genomes.size(); id++)
+            starts.push_back(starts.back() + (snap.isDead(id) ? 0 : snap.genomes[id]->hashCount));
+        out.write(reinterpret_cast<const char*>(starts.data()), starts.size() * sizeof(uint64_t));
+        header.sketchHashes = starts.back();
+    }
+    header.sketches = out.tellp();
+    for (uint32_t id = 0; id < snap.genomes.size() && header.sketchScale > 0; id++)
+        if (!snap.isDead(id))
+            out.write(reinterpret_cast<const char*>(snap.genomes[id]->hashes), snap.genomes[id]->hashCount * sizeof(uint64_t));
+    
+        // an FM-index as it sits in memory, then where each genome starts in its text
+    if (snap.fm != nullptr) {
+        const FMIndex& index = snap.fm->index;
+        header.fmSize = index.size();
+        copy(index.before(), index.before() + FMIndex::SYMBOLS, header.fmBefore);
+        header.fmBlocks = out.tellp();
+        header.fmBlockCount = index.blockCount();
+        out.write(static_cast<const char*>(index.blockData()), index.blockCount() * FMIndex::BLOCK_BYTES);
+        header.fmSamples = out.tellp();
+        header.fmSampleCount = index.sampleCount();
+        out.write(reinterpret_cast<const char*>(index.sampleData()), index.sampleCount() * sizeof(uint32_t));
+        pad();
+        header.fmGenomes = out.tellp();
+        header.fmGenomeCount = snap.fm->starts.size();
+        for (size_t g = 0; g < snap.fm->starts.size(); g++) {
+            IndexFMGenome entry = { snap.fm->starts[g], snap.fm->ids[g] };
+            out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        }
+    }
+    header.fileSize = out.tellp();
+    
+        // go back for the genome table now that the block offsets are known
+    out.seekp(header.genomeTable);
+    out.write(reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(uint64_t));
+    out.close();
+    if (!out)
+        return false;
+    
+    size_t size;
+    shared_ptr<const void> file = mapFile(path, size, true);
+    if (file == nullptr || size != header.fileSize)
+        return false;
+    unsigned char* data = static_cast<unsigned char*>(const_cast<void*>(file.get()));
+    header.dataChecksum = checksum(data + sizeof(header), size - sizeof(header));
+    header.headerChecksum = headerChecksum(header);
+    memcpy(data, &header, sizeof(header));
+    return msync(data, size, MS_SYNC) == 0;
+}
+
+bool GenomeMatcherImpl::open(const string& path, bool verifyChecksum) {
+    // maps a file written by save and serves queries from it in place. By default only the
+    // header, the section bounds and each genome's block and sketch extents are checked, a
+    // constant amount per genome; verifyChecksum adds the data checksum and a pass over
+    // everything queries follow
+    
+    using namespace IndexFile;
+    size_t size;
+    shared_ptr<const void> file = mapFile(path, size);
+    if (file == nullptr || size < sizeof(IndexHeader))
+        return false;
+    const unsigned char* data = static_cast<const unsigned char*>(file.get());
+    IndexHeader header;
+    memcpy(&header, data, sizeof(header));
+    
+        // reject anything that isn't exactly a file this version wrote
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != INDEX_VERSION ||
+        header.headerChecksum != headerChecksum(header) || header.fileSize != size ||
+        header.indexMode > MatcherOptions::FM_INDEX || header.minimizerWindow < 1 || header.bothStrands > 1)
+        return false;
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t width) {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / width;
+    };
+    if (!fits(header.genomeTable, header.genomeCount, sizeof(uint64_t)) ||
+        !fits(header.nodes, header.nodeCount, Trie<Posting, PostingList>::NODE_BYTES) || header.nodeCount == 0 ||
+        !fits(header.lists, header.listCount, sizeof(IndexList)) || !fits(header.pool, header.poolBytes, 1) ||
+        !fits(header.sketchTable, header.sketchScale > 0 ? header.genomeCount + 1 : 0, sizeof(uint64_t)) ||
+        !fits(header.sketches, header.sketchHashes, sizeof(uint64_t)))
+        return false;
+    if (header.genomeCount > UINT32_MAX || header.nodeCount > UINT32_MAX || header.listCount > UINT32_MAX)
+        return false;
+    if (verifyChecksum && header.dataChecksum != checksum(data + sizeof(header), size - sizeof(header)))
+        return false;
+    
+        // A matching checksum only shows the bytes are as written, so a verified open also
+        // checks the runs inside each genome block, the trie's shape, each posting list's
+        // extent and genome IDs, and the FM-index blocks, before any of it is used. Sketches
+        // stay in the file
+    vector<shared_ptr<GenomeEntry>> entries(header.genomeCount);
+    const uint64_t* blocks = reinterpret_cast<const uint64_t*>(data + header.genomeTable);
+    const uint64_t* starts = reinterpret_cast<const uint64_t*>(data + header.sketchTable);
+    const uint64_t* hashes = reinterpret_cast<const uint64_t*>(data + header.sketches);
+    for (uint64_t id = 0; id < header.genomeCount; id++) {
+        if (header.sketchScale > 0 && (starts[id] > starts[id + 1] || starts[id + 1] > header.sketchHashes))
+            return false;
+        if (blocks[id] == 0)
+            continue;
+        Genome genome("", "");
+        if (!fits(blocks[id], 0, 1) || !Genome::mapPacked(reinterpret_cast<const char*>(data + blocks[id]), size - blocks[id], file, genome, verifyChecksum))
+            return false;
+        entries[id] = make_shared<GenomeEntry>(genome);
+        if (header.sketchScale > 0) {
+            entries[id]->hashes = hashes + starts[id];
+            entries[id]->hashCount = starts[id + 1] - starts[id];
+        }
+    }
+    
+        // the k-mer index is served from the file as one read-only segment
+    shared_ptr<Segment> segment = make_shared<Segment>();
+    const IndexList* lists = reinterpret_cast<const IndexList*>(data + header.lists);
+    if (!segment->trie.attach(data + header.nodes, static_cast<uint32_t>(header.nodeCount), static_cast<uint32_t>(header.listCount), verifyChecksum))
+        return false;
+    for (uint64_t i = 0; verifyChecksum && i < header.listCount; i++)
+        if (lists[i].offset > header.poolBytes || lists[i].bytes > header.poolBytes - lists[i].offset ||
+            !PostingList::valid(data + header.pool + lists[i].offset, lists[i].bytes, static_cast<uint32_t>(header.genomeCount)))
+            return false;
+    segment->mappedLists = lists;
+    segment->mappedListCount = header.listCount;
+    segment->mappedPool = data + header.pool;
+    segment->mapping = file;
+    
+        // so is an FM-index, once where each genome starts in its text agrees with the genomes;
+        // genomes removed before the save are still in the text, counted dead until a rebuild
+    shared_ptr<FMState> fm;
+    uint64_t fmDead = 0;
+    if (header.indexMode == MatcherOptions::FM_INDEX) {
+        if (!fits(header.fmBlocks, header.fmBlockCount, FMIndex::BLOCK_BYTES) ||
+            !fits(header.fmSamples, header.fmSampleCount, sizeof(uint32_t)) ||
+            !fits(header.fmGenomes, header.fmGenomeCount, sizeof(IndexFMGenome)) ||
+            header.fmGenomeCount > header.genomeCount || (header.fmGenomeCount == 0) != (header.fmSize == 0))
+            return false;
+        fm = make_shared<FMState>();
+        if (!fm->index.attach(header.fmSize, header.fmBefore, data + header.fmBlocks, header.fmBlockCount,
+                              reinterpret_cast<const uint32_t*>(data + header.fmSamples), header.fmSampleCount, verifyChecksum))
+            return false;
+        const IndexFMGenome* texts = reinterpret_cast<const IndexFMGenome*>(data + header.fmGenomes);
+        uint64_t unindexed = 0;
+        for (uint64_t id = 0; id < header.genomeCount; id++)
+            if (entries[id] != nullptr && entries[id]->genome.length() > 0)
+                unindexed++;
+        for (uint64_t g = 0; g < header.fmGenomeCount; g++) {
+            uint64_t start = texts[g].start;
+            uint64_t end = g + 1 < header.fmGenomeCount ? texts[g + 1].start : header.fmSize;
+            uint32_t id = texts[g].id;
+            if ((g == 0 ? start != 0 : id <= texts[g - 1].id) || end <= start + 1 || id >= header.genomeCount)
+                return false;
+            if (entries[id] == nullptr)
+                fmDead += end - start - 1;
+            else if (end - start - 1 != uint64_t(entries[id]->genome.length()))
+                return false;
+            else
+                unindexed--;
+            fm->starts.push_back(texts[g].start);
+            fm->ids.push_back(id);
+        }
+        if (unindexed != 0)
+            return false;
+        fm->mapping = file;
+    }
+    
+    lock_guard<mutex> lock(m_writer);
+    m_minLength = header.minSearchLength;
+    m_options.indexMode = static_cast<MatcherOptions::IndexMode>(header.indexMode);
+    m_options.minimizerWindow = header.minimizerWindow;
+    m_options.sketchScale = header.sketchScale;
+    m_options.bothStrands = header.bothStrands != 0 && m_options.indexMode == MatcherOptions::ALL_KMERS;
+    
+        // the file's library replaces whatever this matcher held
+    m_genomeIds.clear();
+    m_indexedBases = fmDead;
+    m_deadBases = fmDead;
+    Snapshot* next = new Snapshot;
+    for (uint64_t id = 0; id < header.genomeCount; id++) {
+        if (entries[id] != nullptr) {
+            m_genomeIds[entries[id]->name] = static_cast<uint32_t>(id);
+            m_indexedBases += entries[id]->genome.length();
+        }
+        next->genomes.push_back(entries[id]);
+    }
+    segment->postingCount = m_indexedBases;         // about one a base; it only steers merging
+    segment->genomes = next->genomesFrom(0);
+    
+    if (fm != nullptr)
+        next->fm = fm;
+    else if (!segment->genomes.empty())
+        next->segments.push_back(segment);
+    publish(next);
+    return true;
+}
+
+MatcherStats GenomeMatcherImpl::stats() const {
+    MatcherStats s = {};
+#ifdef GENOMICS_STATS
+    s.enabled = true;
+    s.queries = m_stats.get(Stats::QUERIES);
+    s.trieNodesVisited = m_stats.get(Stats::NODES_VISITED);
+    s.postingsReturned = m_stats.get(Stats::POSTINGS);
+    s.candidatesVerified = m_stats.get(Stats::VERIFIED);
+    s.candidatesAccepted = m_stats.get(Stats::ACCEPTED);
+    s.extractCalls = m_stats.get(Stats::EXTRACT_CALLS);
+    s.extractBytes = m_stats.get(Stats::EXTRACT_BYTES);
+    s.allocations = m_stats.get(Stats::ALLOCATIONS);
+    s.descentSeconds = m_stats.get(Stats::DESCENT_NANOS) / 1e9;
+    s.verifySeconds = m_stats.get(Stats::VERIFY_NANOS) / 1e9;
+#endif
+    s.cacheHits = m_cache.hits();
+    s.cacheMisses = m_cache.misses();
+    return s;
+}
+
+void GenomeMatcherImpl::resetStats() {
+#ifdef GENOMICS_STATS
+    m_stats.reset();
+#endif
+    m_cache.resetCounters();
+}
+
 //******************** GenomeMatcher functions ********************************
 
 // These functions simply delegate to GenomeMatcherImpl's functions.
@@ -264,7 +1996,12 @@ bool GenomeMatcherImpl::sortGenomeMatch(GenomeMatch x, GenomeMatch y) {
 
 GenomeMatcher::GenomeMatcher(int minSearchLength)
 {
-    m_impl = new GenomeMatcherImpl(minSearchLength);
+    m_impl = new GenomeMatcherImpl(minSearchLength, MatcherOptions());
+}
+
+GenomeMatcher::GenomeMatcher(int minSearchLength, const MatcherOptions& options)
+{
+    m_impl = new GenomeMatcherImpl(minSearchLength, options);
 }
 
 GenomeMatcher::~GenomeMatcher()
@@ -277,17 +2014,92 @@ void GenomeMatcher::addGenome(const Genome& genome)
     m_impl->addGenome(genome);
 }
 
+void GenomeMatcher::addGenomes(const vector<Genome>& genomes)
+{
+    m_impl->addGenomes(genomes);
+}
+
+bool GenomeMatcher::addGenomes(istream& fasta)
+{
+    return m_impl->addGenomes(fasta);
+}
+
+bool GenomeMatcher::removeGenome(const string& name)
+{
+    return m_impl->removeGenome(name);
+}
+
+bool GenomeMatcher::replaceGenome(const Genome& genome)
+{
+    return m_impl->replaceGenome(genome);
+}
+
 int GenomeMatcher::minimumSearchLength() const
 {
     return m_impl->minimumSearchLength();
 }
 
+void GenomeMatcher::setWorkerCount(int workers)
+{
+    m_impl->setWorkerCount(workers);
+}
+
+void GenomeMatcher::setResultCacheSize(size_t bytes)
+{
+    m_impl->setResultCacheSize(bytes);
+}
+
+bool GenomeMatcher::save(const string& path) const
+{
+    return m_impl->save(path);
+}
+
+GenomeMatcher* GenomeMatcher::open(const string& path, bool verifyChecksum)
+{
+    GenomeMatcherImpl* impl = new GenomeMatcherImpl(0, MatcherOptions());
+    if (!impl->open(path, verifyChecksum)) {
+        delete impl;
+        return nullptr;
+    }
+    return new GenomeMatcher(impl);
+}
+
+MatcherStats GenomeMatcher::stats() const
+{
+    return m_impl->stats();
+}
+
+void GenomeMatcher::resetStats()
+{
+    m_impl->resetStats();
+}
+
+GenomeMatcher::GenomeMatcher(GenomeMatcherImpl* impl)
+{
+    m_impl = impl;
+}
+
 bool GenomeMatcher::findGenomesWithThisDNA(const string& fragment, int minimumLength, bool exactMatchOnly, vector<DNAMatch>& matches) const
 {
     return m_impl->findGenomesWithThisDNA(fragment, minimumLength, exactMatchOnly, matches);
 }
 
+bool GenomeMatcher::findGenomesWithThisDNA(const vector<string>& fragments, int minimumLength, bool exactMatchOnly, vector<vector<DNAMatch>>& matches) const
+{
+    return m_impl->findGenomesWithThisDNA(fragments, minimumLength, exactMatchOnly, matches);
+}
+
 bool GenomeMatcher::findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, vector<GenomeMatch>& results) const
 {
     return m_impl->findRelatedGenomes(query, fragmentMatchLength, exactMatchOnly, matchPercentThreshold, results);
 }
+
+bool GenomeMatcher::findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, int maxResults, vector<GenomeMatch>& results) const
+{
+    return m_impl->findRelatedGenomes(query, fragmentMatchLength, exactMatchOnly, matchPercentThreshold, maxResults, results);
+}
+
+bool GenomeMatcher::estimateRelatedGenomes(const Genome& query, int fragmentMatchLength, double matchPercentThreshold, vector<GenomeMatch>& results) const
+{
+    return m_impl->estimateRelatedGenomes(query, fragmentMatchLength, matchPercentThreshold, results);
+}
@@ -0,0 +1,123 @@
+#ifndef INDEXFILE_INCLUDED
+#define INDEXFILE_INCLUDED
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// On-disk layout of a saved GenomeMatcher. Every section starts on an 8-byte
+// boundary so the file can be mapped and used in place:
+//
+//   IndexHeader
+//   genome table    genomeCount x uint64, offset of each genome's packed block (0 if superseded)
+//   genome blocks   Genome::writePacked output
+//   trie nodes      nodeCount x Trie::NODE_BYTES
+//   list table      listCount x IndexList, where each posting list sits in the pool
+//   posting pool    PostingList bytes, back to back
+//   sketch table    (genomeCount + 1) x uint64, where each genome's sketch starts in the
+//                   hashes; both sketch sections are empty when sketchScale is 0
+//   sketch hashes   sketchHashes x uint64, each genome's sorted sketch, back to back
+//   FM blocks       fmBlockCount x FMIndex::BLOCK_BYTES
+//   FM samples      fmSampleCount x uint32, the sampled suffix-array entries
+//   FM genomes      fmGenomeCount x IndexFMGenome, where each genome starts in the FM text;
+//                   the three FM sections are empty unless indexMode is FM_INDEX
+//
+// Integers are stored in the writer's native byte order; INDEX_VERSION changes whenever
+// the layout (or the layout of anything it embeds) does.
+
+namespace IndexFile
+{
+    const char MAGIC[8] = { 'G', 'M', 'I', 'N', 'D', 'E', 'X', '\0' };
+    const uint32_t INDEX_VERSION = 6;
+
+    struct IndexHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t minSearchLength;
+        uint32_t indexMode;         // MatcherOptions::IndexMode
+        uint32_t minimizerWindow;
+        uint32_t sketchScale;       // 0 if genomes aren't sketched
+        uint32_t bothStrands;       // 1 if k-mers are keyed by their canonical strand, else 0
+        uint64_t fileSize;
+        uint64_t genomeCount;
+        uint64_t genomeTable;
+        uint64_t nodeCount;
+        uint64_t nodes;
+        uint64_t listCount;
+        uint64_t lists;
+        uint64_t pool;
+        uint64_t poolBytes;
+        uint64_t sketchTable;
+        uint64_t sketches;
+        uint64_t sketchHashes;
+        uint64_t fmSize;            // symbols in the FM text
+        uint32_t fmBefore[6];       // FMIndex::before()
+        uint64_t fmBlocks;
+        uint64_t fmBlockCount;
+        uint64_t fmSamples;
+        uint64_t fmSampleCount;
+        uint64_t fmGenomes;
+        uint64_t fmGenomeCount;
+        uint64_t dataChecksum;      // every byte after the header
+        uint64_t headerChecksum;    // the header up to this field
+    };
+
+    struct IndexList
+    {
+        uint64_t offset;            // from the start of the pool
+        uint64_t bytes;
+    };
+
+    struct IndexFMGenome
+    {
+        uint32_t start;             // FMState::starts
+        uint32_t id;                // FMState::ids
+    };
+
+        // 64-bit checksum over a multiple of 8 bytes, one word per step
+    inline uint64_t checksum(const unsigned char* data, size_t size)
+    {
+        uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+        for (size_t i = 0; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            h ^= word * 0xC2B2AE3D27D4EB4Full;
+            h = ((h << 31) | (h >> 33)) * 0x9E3779B97F4A7C15ull;
+        }
+        return h;
+    }
+
+    inline uint64_t headerChecksum(const IndexHeader& header)
+    {
+        return checksum(reinterpret_cast<const unsigned char*>(&header), offsetof(IndexHeader, headerChecksum));
+    }
+
+        // maps a whole file; the returned pointer unmaps it when the last copy goes away
+    inline std::shared_ptr<const void> mapFile(const std::string& path, size_t& size, bool writable = false)
+    {
+        int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        size = info.st_size;
+        void* data = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            return nullptr;
+        size_t length = size;
+        return std::shared_ptr<const void>(data, [length](const void* p) { munmap(const_cast<void*>(p), length); });
+    }
+}
+
+#endif // INDEXFILE_INCLUDED
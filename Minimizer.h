@@ -0,0 +1,97 @@
+#ifndef MINIMIZER_INCLUDED
+#define MINIMIZER_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <utility>
+#include <cstdint>
+
+// (w,k)-minimizers: of every w consecutive k-mers, the one with the smallest hash
+// (the leftmost on a tie). Two sequences with the same w + k - 1 bases pick the same
+// k-mer at the same offset, so indexing only the minimizers still finds every match
+// that is at least that long.
+//
+// Sequences are given as symbols 0..4 (A, C, G, T, anything else). A k-mer's hash
+// mixes its polynomial value sum(symbol[i] * BASE^(k-1-i)); that value rolls along
+// a sequence and changes by (new - old) * BASE^(k-1-i) when one symbol is replaced.
+
+namespace Minimizer
+{
+    const uint64_t BASE = 0x100000001B3ull;
+
+    inline int symbol(char c) {
+        switch (c) {
+            case 'A': case 'a': return 0;
+            case 'C': case 'c': return 1;
+            case 'G': case 'g': return 2;
+            case 'T': case 't': return 3;
+            default:            return 4;
+        }
+    }
+
+        // murmur3's finalizer: a bijection, so only equal k-mers tie
+    inline uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+        // powers[i] = BASE^i for i < k
+    inline void powers(int k, std::vector<uint64_t>& result) {
+        result.resize(k);
+        uint64_t p = 1;
+        for (int i = 0; i < k; i++, p *= BASE)
+            result[i] = p;
+    }
+
+        // polynomial values of the count - k + 1 k-mers of symbols
+    inline void rawValues(const unsigned char* symbols, int count, int k, const std::vector<uint64_t>& powers, std::vector<uint64_t>& values) {
+        values.clear();
+        uint64_t value = 0;
+        for (int i = 0; i < count; i++) {
+            if (i >= k)
+                value -= symbols[i - k] * powers[k - 1];
+            value = value * BASE + symbols[i];
+            if (i >= k - 1)
+                values.push_back(value);
+        }
+    }
+
+        // start of the minimizer of every window of w k-mers, ascending and without repeats;
+        // a sequence with fewer than w k-mers counts as one window
+    inline void positions(const unsigned char* symbols, int count, int k, int w, std::vector<int>& result) {
+        result.clear();
+        int kmers = count - k + 1;
+        if (kmers <= 0)
+            return;
+        if (w > kmers)
+            w = kmers;
+        std::vector<uint64_t> power;
+        powers(k, power);
+
+            // candidates for the window's minimum as (hash, start), hashes increasing front to back
+        std::deque<std::pair<uint64_t, int>> window;
+        uint64_t value = 0;
+        for (int i = 0; i < count; i++) {
+            if (i >= k)
+                value -= symbols[i - k] * power[k - 1];
+            value = value * BASE + symbols[i];
+            if (i < k - 1)
+                continue;
+            int start = i - k + 1;
+            uint64_t hash = mix(value);
+            while (!window.empty() && window.back().first > hash)
+                window.pop_back();
+            window.push_back(std::make_pair(hash, start));
+            if (window.front().second <= start - w)
+                window.pop_front();
+            if (start >= w - 1 && (result.empty() || result.back() != window.front().second))
+                result.push_back(window.front().second);
+        }
+    }
+}
+
+#endif // MINIMIZER_INCLUDED
@@ -0,0 +1,132 @@
+#include "PackedDNA.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKEDDNA_X86
+#endif
+using namespace std;
+
+namespace PackedDNA
+{
+        // differing bases of word i, as 0b11 pairs (or any nonzero pair)
+    static inline uint64_t difference(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int i)
+    {
+        return (aBases[i] ^ bBases[i]) | (aN[i] ^ bN[i]);
+    }
+
+        // finishes the search one word at a time starting at word, whose bases below from are ignored
+    static inline int finishScalar(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int word, int from, int length)
+    {
+        int lastWord = (length - 1) / BASES_PER_WORD;
+        uint64_t d = difference(aBases, aN, bBases, bN, word) & ~lowBases(from - word * BASES_PER_WORD);
+        for (;;) {
+            if (word == lastWord)
+                d &= lowBases(length - word * BASES_PER_WORD);
+            if (d != 0)
+                return word * BASES_PER_WORD + __builtin_ctzll(d) / 2;
+            if (word == lastWord)
+                return length;
+            word++;
+            d = difference(aBases, aN, bBases, bN, word);
+        }
+    }
+
+    int firstDifferenceScalar(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length)
+    {
+        if (from >= length)
+            return length;
+        return finishScalar(aBases, aN, bBases, bN, from / BASES_PER_WORD, from, length);
+    }
+
+#ifdef PACKEDDNA_X86
+    __attribute__((target("sse2")))
+    int firstDifferenceSSE2(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length)
+    {
+        if (from >= length)
+            return length;
+        int word = from / BASES_PER_WORD;
+        int lastWord = (length - 1) / BASES_PER_WORD;
+
+            // the partial first word, then two whole words per step, leaving the last word to the scalar tail
+        if (difference(aBases, aN, bBases, bN, word) & ~lowBases(from - word * BASES_PER_WORD) || word == lastWord)
+            return finishScalar(aBases, aN, bBases, bN, word, from, length);
+        const __m128i zero = _mm_setzero_si128();
+        for (word++; word + 2 <= lastWord; word += 2) {
+            __m128i bases = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(aBases + word)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(bBases + word)));
+            __m128i n = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(aN + word)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(bN + word)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(bases, n), zero)) != 0xFFFF)
+                break;
+        }
+        return finishScalar(aBases, aN, bBases, bN, word, word * BASES_PER_WORD, length);
+    }
+
+    __attribute__((target("avx2")))
+    int firstDifferenceAVX2(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length)
+    {
+        if (from >= length)
+            return length;
+        int word = from / BASES_PER_WORD;
+        int lastWord = (length - 1) / BASES_PER_WORD;
+
+            // the partial first word, then four whole words per step, leaving the last word to the scalar tail
+        if (difference(aBases, aN, bBases, bN, word) & ~lowBases(from - word * BASES_PER_WORD) || word == lastWord)
+            return finishScalar(aBases, aN, bBases, bN, word, from, length);
+        for (word++; word + 4 <= lastWord; word += 4) {
+            __m256i bases = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(aBases + word)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bBases + word)));
+            __m256i n = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(aN + word)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bN + word)));
+            __m256i d = _mm256_or_si256(bases, n);
+            if (!_mm256_testz_si256(d, d))
+                break;
+        }
+        return finishScalar(aBases, aN, bBases, bN, word, word * BASES_PER_WORD, length);
+    }
+#else
+    int firstDifferenceSSE2(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length)
+    {
+        return firstDifferenceScalar(aBases, aN, bBases, bN, from, length);
+    }
+
+    int firstDifferenceAVX2(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length)
+    {
+        return firstDifferenceScalar(aBases, aN, bBases, bN, from, length);
+    }
+#endif
+
+    using Kernel = int (*)(const uint64_t*, const uint64_t*, const uint64_t*, const uint64_t*, int, int);
+
+        // picked once, on first use
+    static Kernel chooseKernel(const char*& name)
+    {
+#ifdef PACKEDDNA_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            name = "avx2";
+            return firstDifferenceAVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            name = "sse2";
+            return firstDifferenceSSE2;
+        }
+#endif
+        name = "scalar";
+        return firstDifferenceScalar;
+    }
+
+    static const char* kernelName = "scalar";
+
+    static Kernel selectedKernel()
+    {
+        static const Kernel kernel = chooseKernel(kernelName);
+        return kernel;
+    }
+
+    int firstDifference(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length)
+    {
+        return selectedKernel()(aBases, aN, bBases, bN, from, length);
+    }
+
+    const char* firstDifferenceVariant()
+    {
+        selectedKernel();
+        return kernelName;
+    }
+}
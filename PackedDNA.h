@@ -0,0 +1,104 @@
+#ifndef PACKEDDNA_INCLUDED
+#define PACKEDDNA_INCLUDED
+
+#include <string>
+#include <cstdint>
+
+// 2-bit nucleotide packing shared by Genome's storage and anything that wants
+// to compare sequences a word at a time.
+//
+// A packed word holds 32 bases; base i of the word lives in bits 2i and 2i+1,
+// so the first differing base of two words is ctz(a ^ b) / 2.
+// N has no code of its own: it is stored as A and flagged with 0b11 in a
+// parallel mask word, which lets (bases ^ otherBases) | (mask ^ otherMask)
+// find a difference in either one.
+
+namespace PackedDNA
+{
+    const int BASES_PER_WORD = 32;
+
+    // A, C, G, T -> 0..3 (either case); anything else is treated as N
+    constexpr int baseCode(char c) {
+        switch (c) {
+            case 'A': case 'a': return 0;
+            case 'C': case 'c': return 1;
+            case 'G': case 'g': return 2;
+            case 'T': case 't': return 3;
+            default:            return -1;
+        }
+    }
+
+    constexpr char codeBase(int code) {
+        return "ACGT"[code & 3];
+    }
+
+    // number of 64-bit words needed to hold length bases
+    constexpr size_t wordsFor(size_t length) {
+        return (length + BASES_PER_WORD - 1) / BASES_PER_WORD;
+    }
+
+    // mask selecting the low count bases of a word (count in 0..32)
+    constexpr uint64_t lowBases(int count) {
+        return count >= BASES_PER_WORD ? ~uint64_t(0) : (uint64_t(1) << (2 * count)) - 1;
+    }
+
+    // packs up to 32 characters of s starting at position; returns how many were packed
+    inline int packWord(const std::string& s, size_t position, uint64_t& bases, uint64_t& nMask) {
+        bases = 0;
+        nMask = 0;
+        if (position >= s.size())
+            return 0;
+        int count = static_cast<int>(s.size() - position < BASES_PER_WORD ? s.size() - position : BASES_PER_WORD);
+        for (int i = 0; i < count; i++) {
+            int code = baseCode(s[position + i]);
+            if (code < 0)
+                nMask |= uint64_t(3) << (2 * i);
+            else
+                bases |= uint64_t(code) << (2 * i);
+        }
+        return count;
+    }
+
+    // the word's 32 bases in the opposite order
+    inline uint64_t reverseWord(uint64_t w) {
+        w = ((w >> 2) & 0x3333333333333333ull) | ((w & 0x3333333333333333ull) << 2);
+        w = ((w >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((w & 0x0F0F0F0F0F0F0F0Full) << 4);
+        return __builtin_bswap64(w);
+    }
+
+    // Reverse complements length packed bases in place (wordsFor(length) words of each, laid
+    // out from base 0, nothing set past length): reverse the words and the bases in each, shift
+    // the padding of the last word back out, then complement (A^3 = T, C^3 = G). N stays N,
+    // stored as A like any other.
+    inline void reverseComplement(uint64_t* bases, uint64_t* nMask, int length) {
+        int words = static_cast<int>(wordsFor(length));
+        for (int i = 0, j = words - 1; i <= j; i++, j--) {
+            uint64_t b = reverseWord(bases[i]), n = reverseWord(nMask[i]);
+            bases[i] = reverseWord(bases[j]);
+            nMask[i] = reverseWord(nMask[j]);
+            bases[j] = b;
+            nMask[j] = n;
+        }
+        int shift = 2 * (words * BASES_PER_WORD - length);
+        for (int w = 0; w < words; w++) {
+            if (shift > 0) {
+                bases[w] = (bases[w] >> shift) | (w + 1 < words ? bases[w + 1] << (64 - shift) : 0);
+                nMask[w] = (nMask[w] >> shift) | (w + 1 < words ? nMask[w + 1] << (64 - shift) : 0);
+            }
+            bases[w] = ~bases[w] & ~nMask[w] & lowBases(length - w * BASES_PER_WORD);
+        }
+    }
+
+    // Longest-common-prefix kernel: the index of the first base in [from, length) where two
+    // packed sequences differ, in base or in N-ness, or length if they agree throughout.
+    // Each side is a bases array and an N-mask array of wordsFor(length) words laid out from
+    // base 0. firstDifference runs the widest variant the CPU supports (AVX2: 128 bases per
+    // step, SSE2: 64, scalar: 32); the variants are exposed for benchmarking and testing.
+    int firstDifference(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length);
+    int firstDifferenceScalar(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length);
+    int firstDifferenceSSE2(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length);
+    int firstDifferenceAVX2(const uint64_t* aBases, const uint64_t* aN, const uint64_t* bBases, const uint64_t* bN, int from, int length);
+    const char* firstDifferenceVariant();
+}
+
+#endif // PACKEDDNA_INCLUDED
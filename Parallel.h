@@ -0,0 +1,70 @@
+#ifndef PARALLEL_INCLUDED
+#define PARALLEL_INCLUDED
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// Runs body(worker, begin, end) over [0, count) split into chunks of chunkSize, on
+// workers threads (the calling thread is worker 0).
+//
+// Chunks are dealt out to the workers in contiguous ranges up front; a worker takes
+// chunks from the front of its own range and, once that is empty, steals from the
+// back of the others', so an uneven range does not leave the rest idle. A range is
+// one 64-bit word holding (front, back), so taking and stealing are a single CAS.
+template<typename Body>
+void parallelForChunks(int count, int chunkSize, int workers, Body body)
+{
+    if (count <= 0)
+        return;
+    if (chunkSize < 1)
+        chunkSize = 1;
+    int chunks = (count + chunkSize - 1) / chunkSize;
+    if (workers > chunks)
+        workers = chunks;
+    if (workers <= 1) {
+        body(0, 0, count);
+        return;
+    }
+
+    std::unique_ptr<std::atomic<uint64_t>[]> ranges(new std::atomic<uint64_t>[workers]);
+    for (int w = 0; w < workers; w++) {
+        uint64_t front = uint64_t(chunks) * w / workers;
+        uint64_t back = uint64_t(chunks) * (w + 1) / workers;
+        ranges[w].store(front << 32 | back);
+    }
+
+        // takes one chunk from the front (own range) or back (someone else's); -1 if it is empty
+    auto take = [&ranges](int w, bool fromFront) -> int {
+        uint64_t range = ranges[w].load();
+        for (;;) {
+            uint32_t front = uint32_t(range >> 32), back = uint32_t(range);
+            if (front >= back)
+                return -1;
+            uint64_t next = fromFront ? (uint64_t(front + 1) << 32 | back) : (uint64_t(front) << 32 | (back - 1));
+            if (ranges[w].compare_exchange_weak(range, next))
+                return fromFront ? int(front) : int(back - 1);
+        }
+    };
+    auto run = [&](int w) {
+        for (int victim = 0; victim < workers; victim++) {
+            int owner = (w + victim) % workers;
+            for (int chunk = take(owner, owner == w); chunk >= 0; chunk = take(owner, owner == w)) {
+                int begin = chunk * chunkSize;
+                int end = begin + chunkSize < count ? begin + chunkSize : count;
+                body(w, begin, end);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int w = 1; w < workers; w++)
+        threads.push_back(std::thread(run, w));
+    run(0);
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+#endif // PARALLEL_INCLUDED
@@ -0,0 +1,131 @@
+#ifndef POSTINGLIST_INCLUDED
+#define POSTINGLIST_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+
+// One occurrence of an indexed k-mer: which genome, and where in it.
+struct Posting
+{
+    uint32_t genomeId;
+    uint32_t position;
+};
+
+// An append-only list of Postings kept in (genomeId, position) order and stored
+// as varints: each entry is the genome id delta, followed by the position delta
+// when the genome is unchanged or the absolute position when it moves on.
+// Consecutive positions of one genome therefore cost a byte or two each.
+class PostingList
+{
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Posting;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Posting*;
+        using reference = const Posting&;
+
+        const_iterator() : m_next(nullptr), m_end(nullptr), m_current{0, 0} {}
+        const_iterator(const unsigned char* from, const unsigned char* end) : m_next(from), m_end(end), m_current{0, 0} {
+            advance();
+        }
+        const Posting& operator*() const { return m_current; }
+        const Posting* operator->() const { return &m_current; }
+        const_iterator& operator++() {
+            advance();
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator old = *this;
+            advance();
+            return old;
+        }
+            // iterators are only compared against the end of the same list
+        bool operator==(const const_iterator& other) const { return m_next == other.m_next; }
+        bool operator!=(const const_iterator& other) const { return m_next != other.m_next; }
+    private:
+        const unsigned char* m_next;    // start of the entry after m_current, or nullptr once exhausted
+        const unsigned char* m_end;
+        Posting m_current;
+
+        void advance() {
+            if (m_next == nullptr)
+                return;
+            if (m_next == m_end) {
+                m_next = nullptr;
+                return;
+            }
+            uint32_t genomeDelta = readVarint(m_next);
+            uint32_t position = readVarint(m_next);
+            m_current.genomeId += genomeDelta;
+            m_current.position = (genomeDelta == 0) ? m_current.position + position : position;
+        }
+    };
+
+    PostingList() : m_count(0), m_last{0, 0} {}
+
+        // p must not come before the last Posting appended
+    void push_back(const Posting& p) {
+        uint32_t genomeDelta = p.genomeId - m_last.genomeId;
+        writeVarint(genomeDelta);
+        writeVarint(genomeDelta == 0 ? p.position - m_last.position : p.position);
+        m_last = p;
+        m_count++;
+    }
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+    size_t bytes() const { return m_bytes.size(); }
+    const unsigned char* data() const { return m_bytes.data(); }
+    const_iterator begin() const { return const_iterator(m_bytes.data(), m_bytes.data() + m_bytes.size()); }
+    const_iterator end() const { return const_iterator(); }
+
+        // true if bytes at from decode as whole postings, each of a genome below genomes
+    static bool valid(const unsigned char* from, size_t bytes, uint32_t genomes) {
+        const unsigned char* end = from + bytes;
+        uint64_t genomeId = 0;
+        for (int field = 0; from != end; field ^= 1) {
+            uint64_t value = 0;
+            for (int shift = 0; ; shift += 7) {
+                if (from == end || shift > 28)
+                    return false;
+                unsigned char b = *from++;
+                value |= uint64_t(b & 0x7f) << shift;
+                if ((b & 0x80) == 0)
+                    break;
+            }
+            if (field == 0 && (genomeId += value) >= genomes)
+                return false;
+            if (field == 0 && from == end)
+                return false;
+        }
+        return true;
+    }
+
+    static uint32_t readVarint(const unsigned char*& p) {
+        uint32_t value = 0;
+        for (int shift = 0; ; shift += 7) {
+            unsigned char b = *p++;
+            value |= uint32_t(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                return value;
+        }
+    }
+private:
+    std::vector<unsigned char> m_bytes;
+    uint32_t m_count;
+    Posting m_last;
+
+    void writeVarint(uint32_t value) {
+        while (value >= 0x80) {
+            m_bytes.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        m_bytes.push_back(static_cast<unsigned char>(value));
+    }
+};
+
+#endif // POSTINGLIST_INCLUDED
@@ -0,0 +1,76 @@
+#ifndef RADIXSORT_INCLUDED
+#define RADIXSORT_INCLUDED
+
+#include "Parallel.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Stable LSD radix sort of fixed-size records laid out back to back in records.
+// Each record is stride words long and sorts on its first keyWords words, word 0
+// being the most significant. Every pass handles one byte; passes where all
+// records share the same byte are skipped, so unused high bits cost nothing.
+//
+// A pass is split into one contiguous block per worker: every block is counted in
+// parallel, the per-block counts are turned into output offsets, and every block
+// scatters its records in parallel. Blocks keep their order, so the sort is stable.
+inline void radixSortRecords(std::vector<uint64_t>& records, int stride, int keyWords, int workers)
+{
+    const int RADIX = 256;
+    int count = static_cast<int>(records.size() / stride);
+    if (count < 2)
+        return;
+    workers = std::max(1, std::min(workers, count / 4096 + 1));
+    int blockSize = (count + workers - 1) / workers;
+    int blocks = (count + blockSize - 1) / blockSize;
+
+    std::vector<uint64_t> scratch(records.size());
+    std::vector<size_t> offsets(size_t(blocks) * RADIX);
+
+    for (int word = keyWords - 1; word >= 0; word--) {
+        for (int shift = 0; shift < 64; shift += 8) {
+            auto digit = [&](const std::vector<uint64_t>& from, int i) {
+                return int((from[size_t(i) * stride + word] >> shift) & (RADIX - 1));
+            };
+
+                // count each block's digits
+            std::fill(offsets.begin(), offsets.end(), 0);
+            parallelForChunks(count, blockSize, workers, [&](int, int begin, int end) {
+                size_t* histogram = &offsets[size_t(begin / blockSize) * RADIX];
+                for (int i = begin; i < end; i++)
+                    histogram[digit(records, i)]++;
+            });
+
+                // every record has the same digit here: the pass would not move anything
+            bool constant = false;
+            for (int d = 0; d < RADIX && !constant; d++) {
+                size_t total = 0;
+                for (int b = 0; b < blocks; b++)
+                    total += offsets[size_t(b) * RADIX + d];
+                constant = (total == size_t(count));
+            }
+            if (constant)
+                continue;
+
+                // turn counts into where each block writes each digit: digit-major, then block order
+            size_t next = 0;
+            for (int d = 0; d < RADIX; d++)
+                for (int b = 0; b < blocks; b++) {
+                    size_t n = offsets[size_t(b) * RADIX + d];
+                    offsets[size_t(b) * RADIX + d] = next;
+                    next += n;
+                }
+
+            parallelForChunks(count, blockSize, workers, [&](int, int begin, int end) {
+                size_t* cursor = &offsets[size_t(begin / blockSize) * RADIX];
+                for (int i = begin; i < end; i++) {
+                    size_t to = cursor[digit(records, i)]++;
+                    std::copy(&records[size_t(i) * stride], &records[size_t(i) * stride] + stride, &scratch[to * stride]);
+                }
+            });
+            records.swap(scratch);
+        }
+    }
+}
+
+#endif // RADIXSORT_INCLUDED
@@ -0,0 +1,166 @@
+#ifndef RESULTCACHE_INCLUDED
+#define RESULTCACHE_INCLUDED
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// A bounded map from string keys to Values that many threads can share. Keys are
+// spread over SHARDS independently locked shards, each holding its share of the
+// byte budget and evicting with CLOCK: a hit marks its entry referenced, and the
+// hand looking for room clears referenced entries and evicts the first that isn't.
+template<typename Value>
+class ResultCache
+{
+public:
+    static const int SHARDS = 16;
+
+    ResultCache() : m_shardBudget(0) {}
+
+        // bytes is the whole cache's budget; 0 turns it off. Drops everything cached
+    void setBudget(size_t bytes) {
+        for (int s = 0; s < SHARDS; s++) {
+            std::lock_guard<std::mutex> lock(m_shards[s].mutex);
+            m_shards[s].drop();
+        }
+        m_shardBudget = bytes / SHARDS;
+    }
+    bool enabled() const { return m_shardBudget > 0; }
+
+        // copies key's value into value; false on a miss, which misses() counts unless
+        // countMiss is false (a lookup whose answer won't be put back)
+    bool get(const std::string& key, Value& value, bool countMiss = true) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.index.find(key);
+        if (found == shard.index.end()) {
+            if (countMiss)
+                shard.misses++;
+            return false;
+        }
+        Entry& e = shard.entries[found->second];
+        e.referenced = true;
+        value = e.value;
+        shard.hits++;
+        return true;
+    }
+
+        // bytes is what the entry is charged against the budget; entries bigger than a shard's
+        // share aren't kept
+    void put(const std::string& key, const Value& value, size_t bytes) {
+        bytes += key.size() + ENTRY_OVERHEAD;
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (bytes > m_shardBudget || shard.index.count(key) != 0)
+            return;
+        while (shard.bytes + bytes > m_shardBudget)
+            shard.evictOne();
+        uint32_t slot;
+        if (!shard.free.empty()) {
+            slot = shard.free.back();
+            shard.free.pop_back();
+        }
+        else {
+            slot = static_cast<uint32_t>(shard.entries.size());
+            shard.entries.push_back(Entry());
+        }
+        Entry& e = shard.entries[slot];
+        e.key = key;
+        e.value = value;
+        e.bytes = bytes;
+        e.live = true;
+        e.referenced = false;
+        shard.index[key] = slot;
+        shard.bytes += bytes;
+    }
+
+    void clear() {
+        for (int s = 0; s < SHARDS; s++) {
+            std::lock_guard<std::mutex> lock(m_shards[s].mutex);
+            m_shards[s].drop();
+        }
+    }
+
+    uint64_t hits() const { return sum(&Shard::hits); }
+    uint64_t misses() const { return sum(&Shard::misses); }
+    void resetCounters() {
+        for (int s = 0; s < SHARDS; s++) {
+            std::lock_guard<std::mutex> lock(m_shards[s].mutex);
+            m_shards[s].hits = m_shards[s].misses = 0;
+        }
+    }
+
+      // We prevent a ResultCache from being copied or assigned.
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+private:
+    static const size_t ENTRY_OVERHEAD = 96;    // map node, slot and string headers, roughly
+
+    struct Entry
+    {
+        std::string key;
+        Value value;
+        size_t bytes = 0;
+        bool live = false;
+        bool referenced = false;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, uint32_t> index;    // key -> slot in entries
+        std::vector<Entry> entries;
+        std::vector<uint32_t> free;                         // dead slots to reuse
+        size_t hand = 0;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+
+        void evictOne() {
+            for (;;) {
+                if (hand >= entries.size())
+                    hand = 0;
+                Entry& e = entries[hand++];
+                if (!e.live)
+                    continue;
+                if (e.referenced) {
+                    e.referenced = false;
+                    continue;
+                }
+                index.erase(e.key);
+                bytes -= e.bytes;
+                e = Entry();
+                free.push_back(static_cast<uint32_t>(hand - 1));
+                return;
+            }
+        }
+        void drop() {
+            index.clear();
+            std::vector<Entry>().swap(entries);
+            free.clear();
+            hand = 0;
+            bytes = 0;
+        }
+    };
+
+    Shard m_shards[SHARDS];
+    std::atomic<size_t> m_shardBudget;
+
+    Shard& shardFor(const std::string& key) {
+        return m_shards[std::hash<std::string>()(key) % SHARDS];
+    }
+    uint64_t sum(uint64_t Shard::* counter) const {
+        uint64_t total = 0;
+        for (int s = 0; s < SHARDS; s++) {
+            std::lock_guard<std::mutex> lock(m_shards[s].mutex);
+            total += m_shards[s].*counter;
+        }
+        return total;
+    }
+};
+
+#endif // RESULTCACHE_INCLUDED
@@ -0,0 +1,430 @@
+#include "ShardedMatcher.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <mutex>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <dirent.h>
+using namespace std;
+
+    // how much of a shard's share of addGenomes one message carries
+static const size_t ADD_BATCH_BYTES = 64 << 20;
+
+    // findRelatedGenomes' order: higher percentage first, then by name
+static bool sortGenomeMatch(const GenomeMatch& x, const GenomeMatch& y)
+{
+    if (x.percentMatch != y.percentMatch)
+        return x.percentMatch > y.percentMatch;
+    return x.genomeName < y.genomeName;
+}
+
+    // threads in this process, from /proc; 1 where that can't be read
+static int threadCount()
+{
+    DIR* tasks = opendir("/proc/self/task");
+    if (tasks == nullptr)
+        return 1;
+    int count = 0;
+    while (dirent* entry = readdir(tasks))
+        if (entry->d_name[0] != '.')
+            count++;
+    closedir(tasks);
+    return max(count, 1);
+}
+
+ShardedMatcher::ShardedMatcher(int minSearchLength, int shards, const MatcherOptions& options)
+{
+    // each shard is a fork of this process that serves its end of a socket pair until told
+    // to quit or the pair closes. The children aren't exec'd, so they may only fork from a
+    // single thread
+
+    m_minLength = minSearchLength;
+    m_ok = threadCount() <= 1;
+    m_nextId = 0;
+    if (!m_ok)
+        return;
+    for (int i = 0; i < max(shards, 1); i++) {
+        int ends[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, ends) != 0) {
+            m_ok = false;
+            return;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(ends[0]);
+            close(ends[1]);
+            m_ok = false;
+            return;
+        }
+        if (pid == 0) {
+            close(ends[0]);
+            for (size_t j = 0; j < m_shards.size(); j++)
+                close(m_shards[j].fd);
+            _exit(serve(ends[1], minSearchLength, options));
+        }
+        close(ends[1]);
+        m_shards.push_back({pid, ends[0]});
+    }
+}
+
+ShardedMatcher::~ShardedMatcher()
+{
+    for (size_t i = 0; i < m_shards.size(); i++) {
+        Wire::send(m_shards[i].fd, Wire::QUIT, Wire::Writer());
+        close(m_shards[i].fd);
+    }
+    for (size_t i = 0; i < m_shards.size(); i++)
+        waitpid(m_shards[i].pid, nullptr, 0);
+}
+
+bool ShardedMatcher::ok() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_ok;
+}
+
+int ShardedMatcher::shardCount() const
+{
+    return static_cast<int>(m_shards.size());
+}
+
+int ShardedMatcher::minimumSearchLength() const
+{
+    return m_minLength;
+}
+
+void ShardedMatcher::setWorkerCount(int workers)
+{
+    lock_guard<mutex> lock(m_mutex);
+    Wire::Writer request;
+    request.putVarint(max(workers, 1));
+    vector<vector<unsigned char>> replies;
+    broadcast(Wire::SET_WORKERS, request, replies);
+}
+
+void ShardedMatcher::addGenome(const Genome& genome)
+{
+    addGenomes(vector<Genome>(1, genome));
+}
+
+void ShardedMatcher::addGenomes(const vector<Genome>& genomes)
+{
+    // deals the genomes out by ID and sends each shard its share. A name that
+    // was already in the library (or comes up twice) supersedes the older genome, as in a
+    // GenomeMatcher; a shard replaces its own copy when it gets the new one, and copies left
+    // on other shards are removed afterwards
+
+    lock_guard<mutex> lock(m_mutex);
+    int n = static_cast<int>(m_shards.size());
+    vector<vector<const Genome*>> dealt(n);
+    vector<pair<int, string>> stale;
+    for (size_t i = 0; i < genomes.size(); i++) {
+        string name = genomes[i].name();
+        int shard = static_cast<int>(m_nextId % n);
+        auto old = m_placements.find(name);
+        if (old != m_placements.end() && old->second.shard != shard)
+            stale.push_back(make_pair(old->second.shard, name));
+        m_placements[name] = Placement{ m_nextId++, shard };
+        dealt[shard].push_back(&genomes[i]);
+    }
+
+        // each shard's share goes in messages of about ADD_BATCH_BYTES (a genome at most
+        // takes its length plus its name), sent one round to every shard at a time
+    vector<vector<Wire::Writer>> batches(n);
+    string sequence;
+    for (int s = 0; s < n; s++) {
+        size_t first = 0;
+        while (first < dealt[s].size()) {
+            size_t last = first, bytes = 0;
+            do {
+                bytes += dealt[s][last]->length() + dealt[s][last]->name().size() + 20;
+                last++;
+            } while (last < dealt[s].size() && bytes + dealt[s][last]->length() <= ADD_BATCH_BYTES);
+            batches[s].push_back(Wire::Writer());
+            batches[s].back().putVarint(last - first);
+            for (; first < last; first++) {
+                dealt[s][first]->extract(0, dealt[s][first]->length(), sequence);
+                batches[s].back().putString(dealt[s][first]->name());
+                batches[s].back().putSequence(sequence);
+            }
+        }
+    }
+    vector<vector<unsigned char>> replies;
+    for (size_t round = 0; ; round++) {
+        vector<int> shards;
+        vector<Wire::Writer> requests;
+        for (int s = 0; s < n; s++)
+            if (round < batches[s].size()) {
+                shards.push_back(s);
+                requests.push_back(move(batches[s][round]));
+            }
+        if (shards.empty())
+            break;
+        if (!exchange(shards, requests, Wire::ADD_GENOMES, replies))
+            return;
+    }
+
+    sort(stale.begin(), stale.end());
+    stale.erase(unique(stale.begin(), stale.end()), stale.end());
+    for (size_t i = 0; i < stale.size(); i++) {
+        if (m_placements[stale[i].second].shard == stale[i].first)
+            continue;
+        vector<Wire::Writer> remove(1);
+        remove[0].putString(stale[i].second);
+        if (!exchange(vector<int>(1, stale[i].first), remove, Wire::REMOVE_GENOME, replies))
+            return;
+    }
+}
+
+bool ShardedMatcher::removeGenome(const string& name)
+{
+    lock_guard<mutex> lock(m_mutex);
+    auto found = m_placements.find(name);
+    if (found == m_placements.end())
+        return false;
+    vector<Wire::Writer> request(1);
+    request[0].putString(name);
+    vector<vector<unsigned char>> replies;
+    if (!exchange(vector<int>(1, found->second.shard), request, Wire::REMOVE_GENOME, replies))
+        return false;
+    m_placements.erase(found);
+    Wire::Reader in(replies[0]);
+    return in.getVarint() != 0;
+}
+
+bool ShardedMatcher::findGenomesWithThisDNA(const string& fragment, int minimumLength, bool exactMatchOnly, vector<DNAMatch>& matches) const
+{
+    vector<vector<DNAMatch>> all;
+    if (!findGenomesWithThisDNA(vector<string>(1, fragment), minimumLength, exactMatchOnly, all))
+        return false;
+    matches = all[0];
+    return true;
+}
+
+bool ShardedMatcher::findGenomesWithThisDNA(const vector<string>& fragments, int minimumLength, bool exactMatchOnly, vector<vector<DNAMatch>>& matches) const
+{
+    // every shard answers the whole batch for its genomes; a fragment's matches from all of
+    // them are put back in library ID order, as one GenomeMatcher would report them
+
+    lock_guard<mutex> lock(m_mutex);
+    matches.assign(fragments.size(), vector<DNAMatch>());
+    Wire::Writer request;
+    request.putVarint(static_cast<uint64_t>(minimumLength));
+    request.putVarint(exactMatchOnly);
+    request.putVarint(fragments.size());
+    for (size_t i = 0; i < fragments.size(); i++)
+        request.putSequence(fragments[i]);
+    vector<vector<unsigned char>> replies;
+    if (!broadcast(Wire::FIND, request, replies))
+        return false;
+
+    bool found = false;
+    vector<string> names;
+    for (size_t s = 0; s < replies.size(); s++) {
+        Wire::Reader in(replies[s]);
+        found |= in.getVarint() != 0;
+        names.resize(in.getVarint());
+        for (size_t i = 0; i < names.size() && in.ok(); i++)
+            names[i] = in.getString();
+        for (size_t i = 0; i < fragments.size() && in.ok(); i++) {
+            uint64_t count = in.getVarint();
+            for (uint64_t j = 0; j < count && in.ok(); j++) {
+                uint64_t name = in.getVarint();
+                DNAMatch m;
+                m.length = static_cast<int>(in.getVarint());
+                m.position = static_cast<int>(in.getVarint());
+                m.reverseStrand = in.getVarint() != 0;
+                if (name >= names.size())
+                    break;
+                m.genomeName = names[name];
+                matches[i].push_back(m);
+            }
+        }
+        if (!in.ok()) {
+            m_ok = false;
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < matches.size(); i++)
+        sort(matches[i].begin(), matches[i].end(), [this](const DNAMatch& x, const DNAMatch& y) {
+            return m_placements.at(x.genomeName).id < m_placements.at(y.genomeName).id;
+        });
+    return found;
+}
+
+bool ShardedMatcher::findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, vector<GenomeMatch>& results) const
+{
+    return findRelatedGenomes(query, fragmentMatchLength, exactMatchOnly, matchPercentThreshold, 0, results);
+}
+
+bool ShardedMatcher::findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, int maxResults, vector<GenomeMatch>& results) const
+{
+    // a genome's percentage depends only on the query and that genome, so each shard's are
+    // already final; the best maxResults overall are among each shard's best maxResults
+
+    lock_guard<mutex> lock(m_mutex);
+    string sequence;
+    query.extract(0, query.length(), sequence);
+    Wire::Writer request;
+    request.putString(query.name());
+    request.putSequence(sequence);
+    request.putVarint(static_cast<uint64_t>(fragmentMatchLength));
+    request.putVarint(exactMatchOnly);
+    request.putDouble(matchPercentThreshold);
+    request.putVarint(max(maxResults, 0));
+    vector<vector<unsigned char>> replies;
+    if (!broadcast(Wire::RELATED, request, replies))
+        return false;
+
+    vector<GenomeMatch> merged;
+    for (size_t s = 0; s < replies.size(); s++) {
+        Wire::Reader in(replies[s]);
+        in.getVarint();
+        uint64_t count = in.getVarint();
+        for (uint64_t i = 0; i < count && in.ok(); i++) {
+            GenomeMatch m;
+            m.genomeName = in.getString();
+            m.percentMatch = in.getDouble();
+            merged.push_back(m);
+        }
+        if (!in.ok()) {
+            m_ok = false;
+            return false;
+        }
+    }
+    if (merged.empty())
+        return false;
+
+    sort(merged.begin(), merged.end(), sortGenomeMatch);
+    if (maxResults > 0 && merged.size() > size_t(maxResults))
+        merged.resize(maxResults);
+    results = merged;
+    return true;
+}
+
+bool ShardedMatcher::exchange(const vector<int>& shards, const vector<Wire::Writer>& requests, Wire::MessageType type, vector<vector<unsigned char>>& replies) const
+{
+    // sends requests[i] to shards[i], all of them before waiting on any, so the shards work
+    // in parallel; then collects each one's reply. Called with m_mutex held
+
+    if (!m_ok)
+        return false;
+    for (size_t i = 0; i < shards.size(); i++)
+        if (!Wire::send(m_shards[shards[i]].fd, type, requests[i])) {
+            m_ok = false;
+            return false;
+        }
+    replies.resize(shards.size());
+    for (size_t i = 0; i < shards.size(); i++) {
+        Wire::MessageType reply;
+        if (!Wire::receive(m_shards[shards[i]].fd, reply, replies[i]) || reply != Wire::REPLY) {
+            m_ok = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ShardedMatcher::broadcast(Wire::MessageType type, const Wire::Writer& request, vector<vector<unsigned char>>& replies) const
+{
+    vector<int> shards;
+    for (size_t s = 0; s < m_shards.size(); s++)
+        shards.push_back(s);
+    return exchange(shards, vector<Wire::Writer>(m_shards.size(), request), type, replies);
+}
+
+int ShardedMatcher::serve(int fd, int minSearchLength, const MatcherOptions& options)
+{
+    // a shard's side: answer each request from this shard's own GenomeMatcher
+
+    GenomeMatcher matcher(minSearchLength, options);
+    Wire::MessageType type;
+    vector<unsigned char> payload;
+    while (Wire::receive(fd, type, payload)) {
+        Wire::Reader in(payload);
+        Wire::Writer out;
+        switch (type) {
+            case Wire::ADD_GENOMES: {
+                vector<Genome> genomes;
+                uint64_t count = in.getVarint();
+                for (uint64_t i = 0; i < count && in.ok(); i++) {
+                    string name = in.getString();
+                    genomes.push_back(Genome(name, in.getSequence()));
+                }
+                if (in.ok())
+                    matcher.addGenomes(genomes);
+                break;
+            }
+            case Wire::REMOVE_GENOME:
+                out.putVarint(matcher.removeGenome(in.getString()));
+                break;
+            case Wire::SET_WORKERS:
+                matcher.setWorkerCount(static_cast<int>(in.getVarint()));
+                break;
+            case Wire::FIND: {
+                int minimumLength = static_cast<int>(in.getVarint());
+                bool exactMatchOnly = in.getVarint() != 0;
+                vector<string> fragments(in.ok() ? in.getVarint() : 0);
+                for (size_t i = 0; i < fragments.size() && in.ok(); i++)
+                    fragments[i] = in.getSequence();
+                vector<vector<DNAMatch>> matches;
+                bool found = in.ok() && matcher.findGenomesWithThisDNA(fragments, minimumLength, exactMatchOnly, matches);
+                matches.resize(fragments.size());
+
+                    // each genome name goes once, in a table the matches refer to
+                unordered_map<string, uint64_t> index;
+                vector<const string*> names;
+                for (size_t i = 0; i < matches.size(); i++)
+                    for (size_t j = 0; j < matches[i].size(); j++)
+                        if (index.emplace(matches[i][j].genomeName, names.size()).second)
+                            names.push_back(&matches[i][j].genomeName);
+                out.putVarint(found);
+                out.putVarint(names.size());
+                for (size_t i = 0; i < names.size(); i++)
+                    out.putString(*names[i]);
+                for (size_t i = 0; i < matches.size(); i++) {
+                    out.putVarint(matches[i].size());
+                    for (size_t j = 0; j < matches[i].size(); j++) {
+                        out.putVarint(index[matches[i][j].genomeName]);
+                        out.putVarint(matches[i][j].length);
+                        out.putVarint(matches[i][j].position);
+                        out.putVarint(matches[i][j].reverseStrand);
+                    }
+                }
+                break;
+            }
+            case Wire::RELATED: {
+                string name = in.getString();
+                Genome query(name, in.getSequence());
+                int fragmentMatchLength = static_cast<int>(in.getVarint());
+                bool exactMatchOnly = in.getVarint() != 0;
+                double threshold = in.getDouble();
+                int maxResults = static_cast<int>(in.getVarint());
+                vector<GenomeMatch> results;
+                bool found = in.ok() && matcher.findRelatedGenomes(query, fragmentMatchLength, exactMatchOnly, threshold, maxResults, results);
+                if (!found)
+                    results.clear();
+                out.putVarint(found);
+                out.putVarint(results.size());
+                for (size_t i = 0; i < results.size(); i++) {
+                    out.putString(results[i].genomeName);
+                    out.putDouble(results[i].percentMatch);
+                }
+                break;
+            }
+            case Wire::QUIT:
+                return 0;
+            default:
+                return 1;
+        }
+        if (!in.ok() || !Wire::send(fd, Wire::REPLY, out))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef SHARDEDMATCHER_INCLUDED
+#define SHARDEDMATCHER_INCLUDED
+
+#include "provided.h"
+#include "Wire.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <mutex>
+#include <cstdint>
+#include <sys/types.h>
+
+// A GenomeMatcher split across worker processes. Genomes are dealt out by the ID the
+// library gives them as they're added (ID i to shard i % shards); each shard is a child
+// process holding an ordinary GenomeMatcher, reached over a Unix-domain socket pair in
+// the Wire.h format. Every query goes to all shards at once and their answers are
+// merged into exactly what one GenomeMatcher holding every genome would return.
+//
+// Shards are forked without an exec and go on to run threads of their own, so a
+// ShardedMatcher has to be constructed while its process is still single-threaded:
+// a lock some other thread held at the fork (a GenomeMatcher's compactor or query
+// workers, say) would never be released in the child. Constructed otherwise, it
+// starts no shards and ok() is false.
+class ShardedMatcher
+{
+public:
+    ShardedMatcher(int minSearchLength, int shards, const MatcherOptions& options = MatcherOptions());
+    ~ShardedMatcher();
+        // false once a shard couldn't be started or has stopped answering; calls then fail
+    bool ok() const;
+    int shardCount() const;
+    int minimumSearchLength() const;
+        // threads each shard may use
+    void setWorkerCount(int workers);
+    void addGenome(const Genome& genome);
+    void addGenomes(const std::vector<Genome>& genomes);
+    bool removeGenome(const std::string& name);
+    bool findGenomesWithThisDNA(const std::string& fragment, int minimumLength, bool exactMatchOnly, std::vector<DNAMatch>& matches) const;
+    bool findGenomesWithThisDNA(const std::vector<std::string>& fragments, int minimumLength, bool exactMatchOnly, std::vector<std::vector<DNAMatch>>& matches) const;
+    bool findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, std::vector<GenomeMatch>& results) const;
+    bool findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, int maxResults, std::vector<GenomeMatch>& results) const;
+
+      // We prevent a ShardedMatcher from being copied or assigned.
+    ShardedMatcher(const ShardedMatcher&) = delete;
+    ShardedMatcher& operator=(const ShardedMatcher&) = delete;
+private:
+    struct Shard
+    {
+        pid_t pid;
+        int fd;
+    };
+    struct Placement
+    {
+        uint64_t id;            // library-wide genome ID, which orders findGenomesWithThisDNA's results
+        int shard;
+    };
+
+    std::vector<Shard> m_shards;
+    int m_minLength;
+    mutable bool m_ok;
+    uint64_t m_nextId;
+    std::unordered_map<std::string, Placement> m_placements;   // every live genome by name
+    mutable std::mutex m_mutex;                                 // one exchange with the shards at a time
+
+    bool exchange(const std::vector<int>& shards, const std::vector<Wire::Writer>& requests, Wire::MessageType type, std::vector<std::vector<unsigned char>>& replies) const;
+    bool broadcast(Wire::MessageType type, const Wire::Writer& request, std::vector<std::vector<unsigned char>>& replies) const;
+    static int serve(int fd, int minSearchLength, const MatcherOptions& options);
+};
+
+#endif // SHARDEDMATCHER_INCLUDED
@@ -0,0 +1,118 @@
+#include "Sketch.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SKETCH_X86
+#endif
+using namespace std;
+
+namespace Sketch
+{
+    uint64_t intersectScalar(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount)
+    {
+        uint64_t found = 0;
+        size_t i = 0, j = 0;
+        while (i < aCount && j < bCount) {
+            if (a[i] < b[j])
+                i++;
+            else if (b[j] < a[i])
+                j++;
+            else
+                found += counts[i++], j++;
+        }
+        return found;
+    }
+
+#ifdef SKETCH_X86
+        // Both kernels compare a block of a against every rotation of a block of b, add the
+        // counts of a's lanes under the equality mask (no branch per match), and step past
+        // whichever block ends lower (both if they end alike); since neither side repeats a
+        // hash, no pair meets twice. The scalar merge finishes the partial blocks.
+    __attribute__((target("sse4.1")))
+    uint64_t intersectSSE41(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount)
+    {
+        __m128i sums = _mm_setzero_si128();
+        size_t i = 0, j = 0;
+        while (i + 2 <= aCount && j + 2 <= bCount) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+            __m128i equal = _mm_or_si128(_mm_cmpeq_epi64(va, vb), _mm_cmpeq_epi64(va, _mm_shuffle_epi32(vb, 0x4E)));
+            sums = _mm_add_epi64(sums, _mm_and_si128(equal, _mm_cvtepu32_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(counts + i)))));
+            uint64_t aLast = a[i + 1], bLast = b[j + 1];
+            i += aLast <= bLast ? 2 : 0;
+            j += bLast <= aLast ? 2 : 0;
+        }
+        uint64_t found = _mm_extract_epi64(sums, 0) + _mm_extract_epi64(sums, 1);
+        return found + intersectScalar(a + i, counts + i, aCount - i, b + j, bCount - j);
+    }
+
+    __attribute__((target("avx2")))
+    uint64_t intersectAVX2(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount)
+    {
+        __m256i sums = _mm256_setzero_si256();
+        size_t i = 0, j = 0;
+        while (i + 4 <= aCount && j + 4 <= bCount) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+            __m256i equal = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi64(va, vb), _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x39))),
+                _mm256_or_si256(_mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x4E)), _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x93))));
+            sums = _mm256_add_epi64(sums, _mm256_and_si256(equal, _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i)))));
+            uint64_t aLast = a[i + 3], bLast = b[j + 3];
+            i += aLast <= bLast ? 4 : 0;
+            j += bLast <= aLast ? 4 : 0;
+        }
+        __m128i pair = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        uint64_t found = _mm_extract_epi64(pair, 0) + _mm_extract_epi64(pair, 1);
+        return found + intersectScalar(a + i, counts + i, aCount - i, b + j, bCount - j);
+    }
+#else
+    uint64_t intersectSSE41(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount)
+    {
+        return intersectScalar(a, counts, aCount, b, bCount);
+    }
+
+    uint64_t intersectAVX2(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount)
+    {
+        return intersectScalar(a, counts, aCount, b, bCount);
+    }
+#endif
+
+    using Kernel = uint64_t (*)(const uint64_t*, const uint32_t*, size_t, const uint64_t*, size_t);
+
+        // picked once, on first use
+    static Kernel chooseKernel(const char*& name)
+    {
+#ifdef SKETCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            name = "avx2";
+            return intersectAVX2;
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            name = "sse4.1";
+            return intersectSSE41;
+        }
+#endif
+        name = "scalar";
+        return intersectScalar;
+    }
+
+    static const char* kernelName = "scalar";
+
+    static Kernel selectedKernel()
+    {
+        static const Kernel kernel = chooseKernel(kernelName);
+        return kernel;
+    }
+
+    uint64_t intersect(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount)
+    {
+        return selectedKernel()(a, counts, aCount, b, bCount);
+    }
+
+    const char* intersectVariant()
+    {
+        selectedKernel();
+        return kernelName;
+    }
+}
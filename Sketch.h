@@ -0,0 +1,96 @@
+#ifndef SKETCH_INCLUDED
+#define SKETCH_INCLUDED
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "Minimizer.h"
+
+// FracMinHash sketches: of all k-mers of a sequence, keep the hashes that fall in the
+// lowest 1/scale of the hash range. Since the same k-mer always hashes the same, the
+// share of a query's sampled k-mers found in a genome's sketch estimates the share of
+// all its k-mers found in the genome (its containment), from about 1/scale of the data.
+//
+// Hashes are Minimizer::mix of the k-mer's polynomial value, over symbols 0..4 as
+// Minimizer takes them.
+//
+// A query's sample is tallied (sorted, with a count per distinct hash) and intersected
+// with each genome's sorted sketch by a block-merge kernel. Against probing a hash table
+// of the sample with every sketch hash, on a single core with 2000 random sketches of n
+// hashes sharing 2% / 90% of the sample's (ns per sketch hash):
+//
+//     n        probe        scalar merge   SSE4.1       AVX2
+//     500      17.1 / 8.3   15.4 / 7.4     8.6 / 8.1    3.5 / 3.1
+//     5000     12.2 / 8.8   16.7 / 9.4     9.5 / 6.9    4.7 / 3.9
+//     50000    18.0 / 10.3  18.7 / 9.0     11.4 / 6.7   4.5 / 3.9
+
+namespace Sketch
+{
+        // the symbol of the complementary base; N stays N
+    inline uint64_t complement(unsigned char symbol) {
+        return symbol < 4 ? 3 - symbol : 4;
+    }
+
+        // appends the kept hashes of the count - k + 1 k-mers of symbols, in order; canonical
+        // hashes each k-mer's lesser value of itself and its reverse complement, so both
+        // strands of a sequence sample alike
+    inline void sample(const unsigned char* symbols, int count, int k, uint64_t scale, std::vector<uint64_t>& hashes, bool canonical = false) {
+        uint64_t limit = (UINT64_MAX - 1) / scale;     // as sketches have always been cut, so saved ones still agree
+        uint64_t top = 1;
+        for (int i = 1; i < k; i++)
+            top *= Minimizer::BASE;
+            // BASE is odd, so it has an inverse mod 2^64 (Newton's method, from 3 correct bits to 96), and
+            // dividing by it undoes a multiplication exactly
+        uint64_t inverse = Minimizer::BASE;
+        for (int i = 0; i < 5; i++)
+            inverse *= 2 - Minimizer::BASE * inverse;
+        uint64_t value = 0, reverse = 0, power = 1;
+        for (int i = 0; i < count; i++) {
+            if (i >= k)
+                value -= symbols[i - k] * top;
+            value = value * Minimizer::BASE + symbols[i];
+            if (canonical) {
+                    // the reverse complement gains its first symbol at the top and loses its last
+                if (i < k) {
+                    reverse += complement(symbols[i]) * power;
+                    power *= Minimizer::BASE;
+                }
+                else
+                    reverse = (reverse - complement(symbols[i - k])) * inverse + complement(symbols[i]) * top;
+            }
+            if (i >= k - 1) {
+                uint64_t hash = Minimizer::mix(canonical ? std::min(value, reverse) : value);
+                if (hash <= limit)
+                    hashes.push_back(hash);
+            }
+        }
+    }
+
+        // sorts a sample and collapses each run of equal hashes to one, with its length in counts
+    inline void tally(std::vector<uint64_t>& hashes, std::vector<uint32_t>& counts) {
+        std::sort(hashes.begin(), hashes.end());
+        counts.clear();
+        size_t kept = 0;
+        for (size_t i = 0; i < hashes.size(); i++) {
+            if (kept > 0 && hashes[kept - 1] == hashes[i])
+                counts[kept - 1]++;
+            else {
+                hashes[kept++] = hashes[i];
+                counts.push_back(1);
+            }
+        }
+        hashes.resize(kept);
+    }
+
+    // Sorted-intersection kernel: the sum of counts[i] over every a[i] that b also holds,
+    // where a and b each ascend without repeats (a tallied sample against a sketch).
+    // intersect runs the widest variant the CPU supports (AVX2: 4x4 hashes per step,
+    // SSE4.1: 2x2, scalar: a branchy merge); the variants are exposed for benchmarking.
+    uint64_t intersect(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount);
+    uint64_t intersectScalar(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount);
+    uint64_t intersectSSE41(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount);
+    uint64_t intersectAVX2(const uint64_t* a, const uint32_t* counts, size_t aCount, const uint64_t* b, size_t bCount);
+    const char* intersectVariant();
+}
+
+#endif // SKETCH_INCLUDED
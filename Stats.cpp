@@ -0,0 +1,37 @@
+#include "Stats.h"
+
+#ifdef GENOMICS_STATS
+
+#include <new>
+#include <cstdlib>
+
+// Counting allocations means replacing the global operator new for the whole program,
+// so this only exists in instrumented builds. The other forms (nothrow, arrays) forward
+// here by default; delete is replaced alongside so the pair stays malloc/free.
+
+void* operator new(std::size_t size)
+{
+    Stats::add(Stats::ALLOCATIONS, 1);
+    if (size == 0)
+        size = 1;
+    for (;;) {
+        if (void* p = std::malloc(size))
+            return p;
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+#endif // GENOMICS_STATS
@@ -0,0 +1,103 @@
+#ifndef STATS_INCLUDED
+#define STATS_INCLUDED
+
+#include <cstdint>
+
+// Opt-in hot-path counters, compiled in when GENOMICS_STATS is defined
+// (cmake -DGENOMICS_STATS=ON). Without it every macro below expands to nothing.
+//
+// Each thread bumps its own plain counters, so instrumented code never writes a
+// shared cache line. A GENOMICS_SCOPE around a piece of work adds whatever its
+// thread counted meanwhile to a shared Stats::Totals when the scope closes; that
+// is how a GenomeMatcher gets per-matcher figures out of per-thread counters.
+
+namespace Stats
+{
+    enum Counter
+    {
+        QUERIES,
+        NODES_VISITED,          // trie nodes stepped onto (FM-index steps) while looking up fragments
+        POSTINGS,               // postings handed to verification
+        VERIFIED,               // candidates compared against the fragment
+        ACCEPTED,               // candidates that matched for at least minimumLength bases
+        EXTRACT_CALLS,          // Genome::extract calls and packed window reads
+        EXTRACT_BYTES,
+        ALLOCATIONS,            // operator new calls
+        DESCENT_NANOS,          // time spent in trie lookups made ahead of verification
+        VERIFY_NANOS,           // time spent verifying candidates, and in lookups that verify as they go
+        COUNTERS
+    };
+}
+
+#ifdef GENOMICS_STATS
+
+#include <atomic>
+#include <chrono>
+
+namespace Stats
+{
+    struct ThreadCounters
+    {
+        uint64_t values[COUNTERS];
+    };
+    inline thread_local ThreadCounters threadCounters = {};
+
+    inline void add(Counter counter, uint64_t n) {
+        threadCounters.values[counter] += n;
+    }
+
+    struct Totals
+    {
+        std::atomic<uint64_t> values[COUNTERS];
+
+        Totals() { reset(); }
+        void reset() {
+            for (int c = 0; c < COUNTERS; c++)
+                values[c].store(0, std::memory_order_relaxed);
+        }
+        uint64_t get(Counter counter) const {
+            return values[counter].load(std::memory_order_relaxed);
+        }
+    };
+
+        // adds this thread's counts between construction and destruction to totals
+    class Scope
+    {
+    public:
+        Scope(Totals& totals) : m_totals(totals), m_start(threadCounters) {}
+        ~Scope() {
+            for (int c = 0; c < COUNTERS; c++)
+                m_totals.values[c].fetch_add(threadCounters.values[c] - m_start.values[c], std::memory_order_relaxed);
+        }
+    private:
+        Totals& m_totals;
+        ThreadCounters m_start;
+    };
+
+        // adds the nanoseconds between construction and destruction to counter
+    class Timer
+    {
+    public:
+        Timer(Counter counter) : m_counter(counter), m_start(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            add(m_counter, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+        }
+    private:
+        Counter m_counter;
+        std::chrono::steady_clock::time_point m_start;
+    };
+}
+
+#define GENOMICS_COUNT(counter, n) Stats::add(Stats::counter, (n))
+#define GENOMICS_TIMER(name, counter) Stats::Timer name(Stats::counter)
+#define GENOMICS_SCOPE(name, totals) Stats::Scope name(totals)
+
+#else
+
+#define GENOMICS_COUNT(counter, n) ((void)0)
+#define GENOMICS_TIMER(name, counter) ((void)0)
+#define GENOMICS_SCOPE(name, totals) ((void)0)
+
+#endif // GENOMICS_STATS
+
+#endif // STATS_INCLUDED
@@ -0,0 +1,399 @@
+#ifndef TRIE_INCLUDED
+#define TRIE_INCLUDED
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <iostream>
+#include "Stats.h"
+
+    // ValueList is the container kept at each node that ends a key; it needs
+    // push_back, begin and end (e.g. PostingList for compact posting storage).
+template<typename ValueType, typename ValueList = std::vector<ValueType>>
+class Trie
+{
+public:
+    Trie() {
+        // empty root Node with no children
+        m_nodes.push_back(Node());
+        m_nodeData = m_nodes.data();
+        m_attached = false;
+    }
+    ~Trie() {}
+    void reset() {
+        // drops the whole arena at once; swapping with empty vectors releases the memory too
+        std::vector<Node>().swap(m_nodes);
+        std::vector<ValueList>().swap(m_values);
+        m_nodes.push_back(Node());
+        m_nodeData = m_nodes.data();
+        m_attached = false;
+    }
+    void insert(const std::string& key, const ValueType& value) {
+        // inserts value at last node of path that spells out key
+
+        if (key == "" || m_attached)
+            return;
+        for (size_t i = 0; i < key.size(); i++)
+            if (slotFor(key[i]) < 0)
+                return;
+
+            // keeps track of which character in key is being processed
+        int index = 0;
+        uint32_t last = pathFound(key, ROOT, index); // O(L) L is key.length()
+
+        while (index < key.size()) { // O(L) where L is remaining characters in key not found earlier
+                // create a new Node for the first unmatched letter in key and hang it off last
+            uint32_t temp = static_cast<uint32_t>(m_nodes.size());
+            m_nodes.push_back(Node());
+            m_nodes[last].children[slotFor(key[index])] = temp;
+            last = temp;
+            index++;
+        }
+        m_nodeData = m_nodes.data();
+
+            // last now is the Node reached by the last letter in key
+        addValue(last, value);
+    }
+        // Bulk loading: keys given to a SortedLoader must arrive in sorted (ACGTN slot) order,
+        // e.g. from a radix sort. It remembers the node path of the previous key, so each key
+        // only walks or creates the nodes below the prefix it shares with the one before,
+        // and the new nodes of a subtree end up next to each other in the arena.
+    class SortedLoader
+    {
+    public:
+        SortedLoader(Trie& trie) : m_trie(trie), m_path(1, ROOT) {}
+            // shared is how many leading characters key has in common with the previous key (0 for the first)
+        void add(const std::string& key, int shared, const ValueType& value) {
+            if (m_trie.m_attached)
+                return;
+            m_path.resize(shared + 1);
+            for (int depth = shared; depth < static_cast<int>(key.size()); depth++) {
+                uint32_t p = m_path[depth];
+                int slot = slotFor(key[depth]);
+                if (m_trie.m_nodes[p].children[slot] == NO_CHILD) {
+                    uint32_t temp = static_cast<uint32_t>(m_trie.m_nodes.size());
+                    m_trie.m_nodes.push_back(Node());
+                    m_trie.m_nodes[p].children[slot] = temp;
+                }
+                m_path.push_back(m_trie.m_nodes[p].children[slot]);
+            }
+            m_trie.m_nodeData = m_trie.m_nodes.data();
+            m_trie.addValue(m_path.back(), value);
+        }
+    private:
+        Trie& m_trie;
+        std::vector<uint32_t> m_path;       // m_path[d] is the node reached by the first d characters
+    };
+        // The lookup side of SortedLoader: exact lookups of keys given in sorted order resume
+        // from the deepest node the key shares with the previous one instead of from the root.
+    class SortedFinder
+    {
+    public:
+        SortedFinder(const Trie& trie) : m_trie(trie), m_path(1, ROOT) {}
+            // calls visit(list) if key is in the trie; shared is as for SortedLoader::add
+        template<typename Visit>
+        void findList(std::string_view key, int shared, Visit visit) {
+            if (key == "")
+                return;
+            if (shared + 1 < static_cast<int>(m_path.size()))
+                m_path.resize(shared + 1);
+            for (int depth = static_cast<int>(m_path.size()) - 1; depth < static_cast<int>(key.size()); depth++) {
+                uint32_t next = m_trie.child(m_path[depth], key[depth]);
+                if (next == NO_CHILD)
+                    return;
+                GENOMICS_COUNT(NODES_VISITED, 1);
+                m_path.push_back(next);
+            }
+            uint32_t list = m_trie.m_nodeData[m_path[key.size()]].values;
+            if (list != NO_VALUES)
+                visit(list);
+        }
+    private:
+        const Trie& m_trie;
+        std::vector<uint32_t> m_path;       // nodes reached by the previous key's prefixes, as far as it got
+    };
+
+    std::vector<ValueType> find(std::string_view key, bool exactMatchOnly) const {
+        return findWithMismatches(key, exactMatchOnly ? 0 : 1);
+    }
+    std::vector<ValueType> findWithMismatches(std::string_view key, int maxMismatches) const {
+        // values of every key of the same length within Hamming distance maxMismatches of key,
+        // found in one descent; as with find, the first letter must always match
+
+        std::vector<ValueType> results;
+        forEachValue(key, maxMismatches, [&](const ValueType& value) {
+            results.push_back(value);
+            return true;
+        });
+        return results;
+    }
+        // same search, but hands each value to visit(value) as the descent reaches it instead
+        // of collecting them; visit returns false to end the search there. False if it did
+    template<typename Visit>
+    bool forEachValue(std::string_view key, int maxMismatches, Visit visit) const {
+        return findLists(key, maxMismatches, [&](uint32_t list) {
+            if (list >= m_values.size())
+                return true;
+            for (auto it = m_values[list].begin(); it != m_values[list].end(); it++)
+                if (!visit(*it))
+                    return false;
+            return true;
+        });
+    }
+        // same search, but calls visit(list) with the index of each matching node's value list
+        // instead of reading values out; see values() and attach(). visit may return bool, false
+        // ending the search there, in which case findLists returns false
+    template<typename Visit>
+    bool findLists(std::string_view key, int maxMismatches, Visit visit) const {
+        if (key == "")
+            return true;
+        uint32_t first = child(ROOT, key[0]);
+        return first == NO_CHILD || descend(key, 1, first, maxMismatches, visit);
+    }
+    const ValueList& values(uint32_t list) const {
+        return m_values[list];
+    }
+    ValueList& values(uint32_t list) {
+        return m_values[list];
+    }
+    uint32_t listCount() const {
+        return static_cast<uint32_t>(m_values.size());
+    }
+        // drops every empty value list and every node that no longer leads to a value, then
+        // packs what is left (nodes in depth-first order, lists renumbered as they're reached)
+    void prune() {
+        if (m_attached)
+            return;
+        std::vector<Node> nodes(1);
+        std::vector<ValueList> values;
+        copyLive(ROOT, ROOT, nodes, values);
+        m_nodes.swap(nodes);
+        m_values.swap(values);
+        m_nodeData = m_nodes.data();
+    }
+
+        // walks every key of from (which may be attached) into this trie, making the nodes it
+        // lacks, and calls append(list, fromList) with this trie's value list for the key and
+        // from's list index, for the caller to copy the values across
+    template<typename Append>
+    void mergeFrom(const Trie& from, Append append) {
+        if (m_attached)
+            return;
+        mergeNode(from, ROOT, ROOT, append);
+        m_nodeData = m_nodes.data();
+    }
+
+        // Persistence: the nodes are plain data and can be written out as one block
+        // (nodeCount() * NODE_BYTES bytes from nodeData()) together with the value lists.
+        // attach() then serves lookups straight from such a block, e.g. a mapped file,
+        // without copying it. The trie is read-only while attached and findLists reports
+        // list indices for the caller to resolve; detach() copies the nodes back into the
+        // arena, takes ownership of the lists they refer to, and makes it writable again.
+    static constexpr size_t NODE_BYTES = 6 * sizeof(uint32_t);
+    const void* nodeData() const {
+        return m_nodeData;
+    }
+    uint32_t nodeCount() const {
+        return m_attached ? m_attachedCount : static_cast<uint32_t>(m_nodes.size());
+    }
+        // With verify, false (leaving the trie as it was) unless the block is a tree whose
+        // value lists are below listCount: every child index is past its parent's, below
+        // count, and no node is the child of two, so walks over it stay inside it and end.
+        // That is a pass over every node; without it the block is taken as it is
+    bool attach(const void* nodes, uint32_t count, uint32_t listCount, bool verify = true) {
+        const Node* block = static_cast<const Node*>(nodes);
+        std::vector<bool> hasParent(verify ? count : 0, false);
+        for (uint32_t n = 0; verify && n < count; n++) {
+            if (block[n].values != NO_VALUES && block[n].values >= listCount)
+                return false;
+            for (int s = 0; s < SLOTS; s++) {
+                uint32_t child = block[n].children[s];
+                if (child == NO_CHILD)
+                    continue;
+                if (child <= n || child >= count || hasParent[child])
+                    return false;
+                hasParent[child] = true;
+            }
+        }
+        reset();
+        m_nodeData = block;
+        m_attachedCount = count;
+        m_attached = true;
+        return true;
+    }
+    void detach(std::vector<ValueList>&& lists) {
+        if (m_attached)
+            m_nodes.assign(m_nodeData, m_nodeData + m_attachedCount);
+        m_values = std::move(lists);
+        m_nodeData = m_nodes.data();
+        m_attached = false;
+    }
+
+    void printTrie() {
+        printing(ROOT, "", "");
+    }
+
+      // C++11 syntax for preventing copying and assignment
+    Trie(const Trie&) = delete;
+    Trie& operator=(const Trie&) = delete;
+private:
+        // Nodes live in one contiguous arena and refer to each other by 32-bit index.
+        // Children are a fixed array with one slot per base, so following an edge is
+        // a single array read instead of a list scan.
+    static constexpr int SLOTS = 5;
+    static constexpr uint32_t ROOT = 0;
+    static constexpr uint32_t NO_CHILD = 0;         // the root is never anyone's child
+    static constexpr uint32_t NO_VALUES = UINT32_MAX;
+
+    struct Node {
+        uint32_t children[SLOTS] = { NO_CHILD, NO_CHILD, NO_CHILD, NO_CHILD, NO_CHILD };
+        uint32_t values = NO_VALUES;            // index into m_values, only set on nodes that end a key
+    };
+    static_assert(sizeof(Node) == NODE_BYTES, "Node must stay a plain block of indices");
+    std::vector<Node> m_nodes;
+    std::vector<ValueList> m_values;
+    const Node* m_nodeData;                     // m_nodes.data(), or the attached block
+    uint32_t m_attachedCount;
+    bool m_attached;
+
+    template<typename Append>
+    void mergeNode(const Trie& from, uint32_t source, uint32_t to, Append& append) {
+        uint32_t list = from.m_nodeData[source].values;
+        if (list != NO_VALUES) {
+            if (m_nodes[to].values == NO_VALUES) {
+                m_nodes[to].values = static_cast<uint32_t>(m_values.size());
+                m_values.push_back(ValueList());
+            }
+            append(m_values[m_nodes[to].values], list);
+        }
+        for (int s = 0; s < SLOTS; s++) {
+            uint32_t child = from.m_nodeData[source].children[s];
+            if (child == NO_CHILD)
+                continue;
+            if (m_nodes[to].children[s] == NO_CHILD) {
+                uint32_t temp = static_cast<uint32_t>(m_nodes.size());
+                m_nodes.push_back(Node());
+                m_nodes[to].children[s] = temp;
+            }
+            mergeNode(from, child, m_nodes[to].children[s], append);
+        }
+    }
+    bool copyLive(uint32_t from, uint32_t to, std::vector<Node>& nodes, std::vector<ValueList>& values) {
+        // copies the part of from's subtree that leads to a non-empty list below nodes[to];
+        // false if there is none
+        bool live = false;
+        uint32_t list = m_nodes[from].values;
+        if (list != NO_VALUES && !m_values[list].empty()) {
+            nodes[to].values = static_cast<uint32_t>(values.size());
+            values.push_back(std::move(m_values[list]));
+            live = true;
+        }
+        for (int s = 0; s < SLOTS; s++) {
+            uint32_t child = m_nodes[from].children[s];
+            if (child == NO_CHILD)
+                continue;
+            uint32_t copy = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(Node());
+            if (copyLive(child, copy, nodes, values)) {
+                nodes[to].children[s] = copy;
+                live = true;
+            }
+            else
+                nodes.resize(copy);
+        }
+        return live;
+    }
+
+    static constexpr int slotFor(char c) {
+        switch (c) {
+            case 'A': case 'a': return 0;
+            case 'C': case 'c': return 1;
+            case 'G': case 'g': return 2;
+            case 'T': case 't': return 3;
+            case 'N': case 'n': return 4;
+            default:            return -1;
+        }
+    }
+    static constexpr char slotChar(int slot) {
+        return "ACGTN"[slot];
+    }
+
+    uint32_t child(uint32_t p, char c) const {
+        int slot = slotFor(c);
+        return slot < 0 ? NO_CHILD : m_nodeData[p].children[slot];
+    }
+    uint32_t pathFound(std::string_view key, uint32_t p, int& index) const {
+        // returns last Node that has a match with key, and index is either end of key or first unmatched character
+        // O(L) where L is length of key
+
+        while (index < static_cast<int>(key.size())) {
+            uint32_t next = child(p, key[index]);
+            if (next == NO_CHILD)
+                break;
+            GENOMICS_COUNT(NODES_VISITED, 1);
+            p = next;
+            index++;
+        }
+        return p;
+    }
+    void addValue(uint32_t p, const ValueType& value) {
+        if (m_nodes[p].values == NO_VALUES) {
+            m_nodes[p].values = static_cast<uint32_t>(m_values.size());
+            m_values.push_back(ValueList());
+        }
+        m_values[m_nodes[p].values].push_back(value);
+    }
+    template<typename Visit>
+    static bool report(Visit& visit, uint32_t list) {
+        // visit(list), carrying on unless visit returns false
+        if constexpr (std::is_void_v<decltype(visit(list))>) {
+            visit(list);
+            return true;
+        }
+        else
+            return visit(list);
+    }
+    template<typename Visit>
+    bool descend(std::string_view key, int depth, uint32_t p, int budget, Visit& visit) const {
+        // p has matched key[0, depth) with budget mismatches left to spend; false once visit stops the search
+        GENOMICS_COUNT(NODES_VISITED, 1);
+
+            // out of budget: the rest has to match exactly, which is a plain walk
+        if (budget == 0) {
+            uint32_t last = pathFound(key, p, depth);
+            if (depth >= static_cast<int>(key.size()) && m_nodeData[last].values != NO_VALUES)
+                return report(visit, m_nodeData[last].values);
+            return true;
+        }
+        if (depth == static_cast<int>(key.size())) {
+            if (m_nodeData[p].values != NO_VALUES)
+                return report(visit, m_nodeData[p].values);
+            return true;
+        }
+
+            // follow the matching child for free, and spend one mismatch on each of its siblings
+        int keep = slotFor(key[depth]);
+        for (int s = 0; s < SLOTS; s++) {
+            uint32_t next = m_nodeData[p].children[s];
+            if (next != NO_CHILD && !descend(key, depth + 1, next, s == keep ? budget : budget - 1, visit))
+                return false;
+        }
+        return true;
+    }
+
+    void printing(uint32_t p, std::string associated, std::string tabs) {
+        std::cout << tabs << associated << ": ";
+        if (m_nodeData[p].values < m_values.size())
+            for (const auto& v : m_values[m_nodeData[p].values])
+                std::cout << v << " ";
+        std::cout << std::endl;
+
+        for (int s = 0; s < SLOTS; s++)
+            if (m_nodeData[p].children[s] != NO_CHILD)
+                printing(m_nodeData[p].children[s], std::string(1, slotChar(s)), tabs + "  ");
+    }
+};
+
+#endif // TRIE_INCLUDED
@@ -0,0 +1,251 @@
+#ifndef WIRE_INCLUDED
+#define WIRE_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// Binary messages between a ShardedMatcher and its shard processes.
+//
+// A message is a 4-byte length (of what follows), a type byte, then the payload.
+// Integers in a payload are LEB128 varints, strings are a varint length and the
+// bytes, doubles are their 8 raw bytes. DNA goes as a sequence: varint length, a
+// mode byte, then either (PACKED) 4 bases a byte plus the runs of N as varint
+// (gap, length) pairs, or (RAW) the characters themselves when anything other
+// than upper-case ACGTN appears. Both ends are the same build on the same
+// machine, so byte order is native.
+
+namespace Wire
+{
+    enum MessageType : uint8_t
+    {
+        ADD_GENOMES,        // count, then (name, sequence) each
+        REMOVE_GENOME,      // name
+        SET_WORKERS,        // count
+        FIND,               // minimumLength, exactMatchOnly, count, then each fragment as a sequence
+        RELATED,            // name, sequence, fragmentMatchLength, exactMatchOnly, threshold, maxResults
+        REPLY,
+        QUIT
+    };
+
+        // the most a message may carry: its length has to fit the 4-byte header, and a
+        // receiver shouldn't allocate more than this on the sender's say-so
+    const size_t MAX_PAYLOAD = size_t(3) << 30;
+
+    const unsigned char PACKED = 0;
+    const unsigned char RAW = 1;
+
+        // 2-bit code of an upper-case base, -1 for anything else
+    inline int code(char c) {
+        switch (c) {
+            case 'A': return 0;
+            case 'C': return 1;
+            case 'G': return 2;
+            case 'T': return 3;
+            default:  return -1;
+        }
+    }
+
+    class Writer
+    {
+    public:
+        void putVarint(uint64_t value) {
+            while (value >= 0x80) {
+                m_bytes.push_back(static_cast<unsigned char>(value | 0x80));
+                value >>= 7;
+            }
+            m_bytes.push_back(static_cast<unsigned char>(value));
+        }
+        void putString(const std::string& s) {
+            putVarint(s.size());
+            m_bytes.insert(m_bytes.end(), s.begin(), s.end());
+        }
+        void putDouble(double d) {
+            unsigned char raw[sizeof(double)];
+            memcpy(raw, &d, sizeof(d));
+            m_bytes.insert(m_bytes.end(), raw, raw + sizeof(raw));
+        }
+        void putSequence(const std::string& s) {
+            putVarint(s.size());
+            for (size_t i = 0; i < s.size(); i++)
+                if (code(s[i]) < 0 && s[i] != 'N') {
+                    m_bytes.push_back(RAW);
+                    m_bytes.insert(m_bytes.end(), s.begin(), s.end());
+                    return;
+                }
+            m_bytes.push_back(PACKED);
+            size_t at = m_bytes.size();
+            m_bytes.resize(at + (s.size() + 3) / 4, 0);
+            std::vector<std::pair<size_t, size_t>> runs;
+            for (size_t i = 0; i < s.size(); i++) {
+                int c = code(s[i]);
+                if (c < 0) {
+                    if (!runs.empty() && runs.back().first + runs.back().second == i)
+                        runs.back().second++;
+                    else
+                        runs.push_back(std::make_pair(i, size_t(1)));
+                    continue;
+                }
+                m_bytes[at + i / 4] |= static_cast<unsigned char>(c << (2 * (i % 4)));
+            }
+            putVarint(runs.size());
+            size_t last = 0;
+            for (size_t r = 0; r < runs.size(); r++) {
+                putVarint(runs[r].first - last);
+                putVarint(runs[r].second);
+                last = runs[r].first + runs[r].second;
+            }
+        }
+        const std::vector<unsigned char>& bytes() const { return m_bytes; }
+        void clear() { m_bytes.clear(); }
+    private:
+        std::vector<unsigned char> m_bytes;
+    };
+
+        // reads what a Writer wrote; once anything runs past the end, ok() stays false and
+        // every read returns zero or empty
+    class Reader
+    {
+    public:
+        Reader(const std::vector<unsigned char>& bytes) : m_next(bytes.data()), m_end(bytes.data() + bytes.size()), m_ok(true) {}
+        bool ok() const { return m_ok; }
+        uint64_t getVarint() {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (m_next == m_end)
+                    return fail();
+                unsigned char b = *m_next++;
+                value |= uint64_t(b & 0x7F) << shift;
+                if (!(b & 0x80))
+                    return value;
+            }
+            return fail();
+        }
+        std::string getString() {
+            std::string s;
+            uint64_t n = getVarint();
+            if (n > size_t(m_end - m_next)) {
+                fail();
+                return s;
+            }
+            s.assign(reinterpret_cast<const char*>(m_next), n);
+            m_next += n;
+            return s;
+        }
+        double getDouble() {
+            double d = 0;
+            if (size_t(m_end - m_next) < sizeof(d)) {
+                fail();
+                return d;
+            }
+            memcpy(&d, m_next, sizeof(d));
+            m_next += sizeof(d);
+            return d;
+        }
+        std::string getSequence() {
+            std::string s;
+            uint64_t n = getVarint();
+            if (m_next == m_end) {
+                fail();
+                return s;
+            }
+            unsigned char mode = *m_next++;
+            if (mode == RAW) {
+                if (n > size_t(m_end - m_next)) {
+                    fail();
+                    return s;
+                }
+                s.assign(reinterpret_cast<const char*>(m_next), n);
+                m_next += n;
+                return s;
+            }
+            if (mode != PACKED || (n + 3) / 4 > size_t(m_end - m_next)) {
+                fail();
+                return s;
+            }
+            s.resize(n);
+            for (size_t i = 0; i < n; i++)
+                s[i] = "ACGT"[(m_next[i / 4] >> (2 * (i % 4))) & 3];
+            m_next += (n + 3) / 4;
+            uint64_t runs = getVarint();
+            size_t at = 0;
+            for (uint64_t r = 0; r < runs && m_ok; r++) {
+                at += getVarint();
+                uint64_t length = getVarint();
+                if (at > n || length > n - at) {
+                    fail();
+                    return std::string();
+                }
+                s.replace(at, length, length, 'N');
+                at += length;
+            }
+            return s;
+        }
+    private:
+        const unsigned char* m_next;
+        const unsigned char* m_end;
+        bool m_ok;
+
+        uint64_t fail() {
+            m_ok = false;
+            m_next = m_end;
+            return 0;
+        }
+    };
+
+        // whole-buffer read and write on a blocking socket, retrying short transfers; a peer
+        // that has gone away fails the write instead of raising SIGPIPE
+    inline bool writeAll(int fd, const unsigned char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+    inline bool readAll(int fd, unsigned char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::read(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    inline bool send(int fd, MessageType type, const Writer& payload) {
+        if (payload.bytes().size() > MAX_PAYLOAD)
+            return false;
+        uint32_t length = static_cast<uint32_t>(payload.bytes().size() + 1);
+        unsigned char head[5];
+        memcpy(head, &length, 4);
+        head[4] = type;
+        return writeAll(fd, head, sizeof(head)) && writeAll(fd, payload.bytes().data(), payload.bytes().size());
+    }
+    inline bool receive(int fd, MessageType& type, std::vector<unsigned char>& payload) {
+        uint32_t length;
+        unsigned char head[5];
+        if (!readAll(fd, head, sizeof(head)))
+            return false;
+        memcpy(&length, head, 4);
+        if (length == 0 || length - 1 > MAX_PAYLOAD)
+            return false;
+        type = static_cast<MessageType>(head[4]);
+        payload.resize(length - 1);
+        return readAll(fd, payload.data(), payload.size());
+    }
+}
+
+#endif // WIRE_INCLUDED
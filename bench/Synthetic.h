@@ -0,0 +1,90 @@
+#ifndef SYNTHETIC_INCLUDED
+#define SYNTHETIC_INCLUDED
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <ostream>
+#include <cstdint>
+
+// Synthetic DNA for benchmarks: random sequences with a chosen GC content and
+// density of N runs, and mutated copies of them that stand in for related genomes.
+// Everything is driven by one seeded generator, so a seed reproduces a data set.
+
+namespace Synthetic
+{
+    struct Options
+    {
+        size_t length = 1000000;
+        double gcContent = 0.5;         // fraction of non-N bases that are C or G
+        double nDensity = 0.0;          // fraction of bases that are N, in runs of 1..MAX_N_RUN
+        double mutationRate = 0.0;      // per-base chance of a mutation in a mutated copy
+        uint64_t seed = 1;
+    };
+
+    const int MAX_N_RUN = 16;
+
+    inline char randomBase(double gcContent, std::mt19937_64& rng)
+    {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        bool strong = unit(rng) < gcContent;
+        bool second = (rng() & 1) != 0;
+        return strong ? (second ? 'G' : 'C') : (second ? 'T' : 'A');
+    }
+
+    inline std::string randomSequence(const Options& options, std::mt19937_64& rng)
+    {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+            // runs average (1 + MAX_N_RUN) / 2 bases, so start one that much less often
+        double runStart = options.nDensity * 2.0 / (1 + MAX_N_RUN);
+        std::string s;
+        s.reserve(options.length);
+        while (s.size() < options.length) {
+            if (runStart > 0 && unit(rng) < runStart) {
+                size_t run = 1 + rng() % MAX_N_RUN;
+                s.append(std::min(run, options.length - s.size()), 'N');
+            }
+            else
+                s += randomBase(options.gcContent, rng);
+        }
+        return s;
+    }
+
+        // a copy of reference where each base is, with probability mutationRate, substituted
+        // (80%), deleted (10%) or followed by an inserted base (10%)
+    inline std::string mutate(const std::string& reference, const Options& options, std::mt19937_64& rng)
+    {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::string s;
+        s.reserve(reference.size() + reference.size() / 16);
+        for (size_t i = 0; i < reference.size(); i++) {
+            if (options.mutationRate <= 0 || unit(rng) >= options.mutationRate) {
+                s += reference[i];
+                continue;
+            }
+            int kind = static_cast<int>(rng() % 10);
+            if (kind < 8) {
+                char c;
+                do
+                    c = randomBase(options.gcContent, rng);
+                while (c == reference[i]);
+                s += c;
+            }
+            else if (kind == 9) {
+                s += reference[i];
+                s += randomBase(options.gcContent, rng);
+            }
+        }
+        return s;
+    }
+
+    inline void writeFasta(std::ostream& out, const std::string& name, const std::string& sequence, int lineWidth = 80)
+    {
+        out << '>' << name << '\n';
+        for (size_t i = 0; i < sequence.size(); i += lineWidth)
+            out.write(sequence.data() + i, std::min(sequence.size() - i, size_t(lineWidth))) << '\n';
+    }
+}
+
+#endif // SYNTHETIC_INCLUDED
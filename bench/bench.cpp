@@ -0,0 +1,443 @@
+#include "provided.h"
+#include "Synthetic.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+using namespace std;
+
+// Times the load, index build (addGenome, addGenomes, and ingest straight from the
+// FASTA file) and query paths on synthetic genomes, for every combination of genome
+// count and minSearchLength asked for, and reports each phase's throughput together
+// with the process's peak RSS so far.
+//
+//   genomics_bench [--genomes 1,4,16] [--length BASES] [--k 12,20] [--queries N]
+//                  [--fragment BASES] [--workers N] [--gc F] [--n-density F]
+//                  [--mutation-rate F] [--seed S] [--minimizers W | --fm-index]
+//                  [--cache MB] [--sketch S] [--json PATH] [--quick]
+//
+// --minimizers builds minimizer-sampled indexes with window W instead of indexing every k-mer;
+// --fm-index uses the FM-index backend. --cache gives the query matcher a result cache.
+// --sketch keeps a FracMinHash sketch of 1/S of each genome's k-mers and adds a
+// sketch-only related_estimate phase.
+//
+// mixed_find runs finds on --workers reader threads while the main thread adds and removes
+// genomes (mixed_write); readers never wait for the writer, so their rate shows what
+// ingestion costs queries. Its hits depend on timing.
+//
+// A human-readable table goes to stderr; the JSON report goes to --json, or to
+// stdout without it. "hits" counts the matches each phase found, so two runs over
+// the same seed can be checked for the same answers as well as compared for speed.
+//
+// Built with -DGENOMICS_STATS=ON it also reruns the single-fragment queries once the
+// query path has warmed up (find_steady_*) and exits with status 1 if any of them
+// allocated, as a steady-state query should allocate nothing (tests/allocation_test
+// checks the same on every build).
+
+struct Config
+{
+    vector<int> genomeCounts = { 1, 4, 16 };
+    vector<int> minSearchLengths = { 12, 20 };
+    int queries = 2000;
+    int fragmentLength = 0;         // 0: twice minSearchLength
+    int workers = 1;
+    size_t cacheBytes = 0;
+    MatcherOptions index;
+    Synthetic::Options data;
+    string jsonPath;
+};
+
+struct Result
+{
+    int genomes;
+    int minSearchLength;
+    string phase;
+    double seconds;
+    double items;                   // bases or queries handled
+    string unit;
+    long hits;
+    long peakRssKB;
+    MatcherStats stats;             // enabled only for query phases of an instrumented build
+};
+
+class Timer
+{
+public:
+    Timer() : m_start(chrono::steady_clock::now()) {}
+    double seconds() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - m_start).count();
+    }
+private:
+    chrono::steady_clock::time_point m_start;
+};
+
+long peakRssKB()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+    return usage.ru_maxrss;         // kilobytes on Linux
+}
+
+vector<int> parseList(const string& s)
+{
+    vector<int> values;
+    stringstream in(s);
+    string item;
+    while (getline(in, item, ','))
+        if (!item.empty())
+            values.push_back(atoi(item.c_str()));
+    return values;
+}
+
+void usage()
+{
+    cerr << "usage: genomics_bench [--genomes 1,4,16] [--length BASES] [--k 12,20] [--queries N]" << endl
+         << "                      [--fragment BASES] [--workers N] [--gc F] [--n-density F]" << endl
+         << "                      [--mutation-rate F] [--seed S] [--minimizers W | --fm-index]" << endl
+         << "                      [--cache MB] [--sketch S] [--json PATH] [--quick]" << endl;
+}
+
+bool parseArgs(int argc, char* argv[], Config& config)
+{
+    config.data.length = 200000;
+    config.data.nDensity = 0.001;
+    config.data.mutationRate = 0.01;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--quick") {
+            config.genomeCounts = { 1, 4 };
+            config.minSearchLengths = { 12 };
+            config.data.length = 20000;
+            config.queries = 200;
+            continue;
+        }
+        if (arg == "--fm-index") {
+            config.index.indexMode = MatcherOptions::FM_INDEX;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        string value = argv[++i];
+        if (arg == "--genomes")
+            config.genomeCounts = parseList(value);
+        else if (arg == "--k")
+            config.minSearchLengths = parseList(value);
+        else if (arg == "--length")
+            config.data.length = strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--queries")
+            config.queries = atoi(value.c_str());
+        else if (arg == "--fragment")
+            config.fragmentLength = atoi(value.c_str());
+        else if (arg == "--workers")
+            config.workers = atoi(value.c_str());
+        else if (arg == "--gc")
+            config.data.gcContent = atof(value.c_str());
+        else if (arg == "--n-density")
+            config.data.nDensity = atof(value.c_str());
+        else if (arg == "--mutation-rate")
+            config.data.mutationRate = atof(value.c_str());
+        else if (arg == "--seed")
+            config.data.seed = strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--minimizers") {
+            config.index.indexMode = MatcherOptions::MINIMIZERS;
+            config.index.minimizerWindow = atoi(value.c_str());
+        }
+        else if (arg == "--cache")
+            config.cacheBytes = size_t(atof(value.c_str()) * (1 << 20));
+        else if (arg == "--sketch")
+            config.index.sketchScale = atoi(value.c_str());
+        else if (arg == "--json")
+            config.jsonPath = value;
+        else
+            return false;
+    }
+    return !config.genomeCounts.empty() && !config.minSearchLengths.empty() && config.data.length > 0;
+}
+
+    // fragments cut from random genomes, half of them with one base substituted
+vector<string> makeQueries(const vector<Genome>& genomes, int count, int length, mt19937_64& rng)
+{
+    vector<string> queries;
+    string fragment;
+    for (int i = 0; i < count; i++) {
+        const Genome& g = genomes[rng() % genomes.size()];
+        if (g.length() < length)
+            continue;
+        g.extract(static_cast<int>(rng() % (g.length() - length + 1)), length, fragment);
+        if (rng() % 2)
+            fragment[1 + rng() % (length - 1)] = "ACGT"[rng() % 4];
+        queries.push_back(fragment);
+    }
+    return queries;
+}
+
+void record(vector<Result>& results, int genomes, int k, const string& phase, double seconds, double items, const string& unit, long hits, const MatcherStats& stats = MatcherStats())
+{
+    Result r = { genomes, k, phase, seconds, items, unit, hits, peakRssKB(), stats };
+    results.push_back(r);
+    cerr << setw(8) << genomes << setw(6) << k << "  " << left << setw(22) << phase << right
+         << setw(10) << fixed << setprecision(4) << seconds << " s"
+         << setw(14) << setprecision(0) << (seconds > 0 ? items / seconds : 0) << ' ' << left << setw(9) << (unit + "/s") << right
+         << setw(10) << hits << " hits" << setw(10) << r.peakRssKB << " KB" << endl;
+}
+
+long runFinds(const GenomeMatcher& matcher, const vector<string>& queries, int minimumLength, bool exact)
+{
+    long hits = 0;
+    vector<DNAMatch> matches;
+    for (size_t i = 0; i < queries.size(); i++)
+        if (matcher.findGenomesWithThisDNA(queries[i], minimumLength, exact, matches))
+            hits += matches.size();
+    return hits;
+}
+
+    // runs every query once so the thread's scratch and the result vector grow to fit, then
+    // again counting allocations; the counts are in the returned stats
+MatcherStats steadyFinds(GenomeMatcher& matcher, const vector<string>& queries, int minimumLength, bool exact, long& hits)
+{
+    vector<DNAMatch> matches;
+    for (size_t i = 0; i < queries.size(); i++)
+        matcher.findGenomesWithThisDNA(queries[i], minimumLength, exact, matches);
+    matcher.resetStats();
+    hits = 0;
+    for (size_t i = 0; i < queries.size(); i++)
+        if (matcher.findGenomesWithThisDNA(queries[i], minimumLength, exact, matches))
+            hits += matches.size();
+    return matcher.stats();
+}
+
+long runBatch(const GenomeMatcher& matcher, const vector<string>& queries, int minimumLength, bool exact)
+{
+    long hits = 0;
+    vector<vector<DNAMatch>> matches;
+    matcher.findGenomesWithThisDNA(queries, minimumLength, exact, matches);
+    for (size_t i = 0; i < matches.size(); i++)
+        hits += matches[i].size();
+    return hits;
+}
+
+int allocatingPhases = 0;
+
+void benchmark(const Config& config, int genomeCount, vector<Result>& results)
+{
+    mt19937_64 rng(config.data.seed);
+
+        // one reference and mutated copies of it, written out so loading is timed from a file
+    string reference = Synthetic::randomSequence(config.data, rng);
+    char path[] = "/tmp/genomics_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        cerr << "cannot create a temporary file" << endl;
+        return;
+    }
+    close(fd);
+    {
+        ofstream out(path);
+        Synthetic::writeFasta(out, "reference", reference);
+        for (int g = 1; g < genomeCount; g++)
+            Synthetic::writeFasta(out, "mutant_" + to_string(g), Synthetic::mutate(reference, config.data, rng));
+    }
+
+    vector<Genome> genomes;
+    Timer loadTimer;
+    bool loaded = Genome::load(path, genomes);
+    double loadSeconds = loadTimer.seconds();
+    if (!loaded || genomes.empty()) {
+        cerr << "cannot load the generated genomes" << endl;
+        remove(path);
+        return;
+    }
+    double bases = 0;
+    for (size_t i = 0; i < genomes.size(); i++)
+        bases += genomes[i].length();
+    record(results, genomeCount, 0, "load", loadSeconds, bases, "bases", static_cast<long>(genomes.size()));
+
+    for (int k : config.minSearchLengths) {
+        int fragmentLength = config.fragmentLength > 0 ? config.fragmentLength : 2 * k;
+        {
+            GenomeMatcher matcher(k, config.index);
+            Timer timer;
+            for (size_t i = 0; i < genomes.size(); i++)
+                matcher.addGenome(genomes[i]);
+            record(results, genomeCount, k, "addGenome", timer.seconds(), bases, "bases", 0);
+        }
+        {
+                // straight from the file, parsing and indexing overlapped
+            GenomeMatcher matcher(k, config.index);
+            matcher.setWorkerCount(config.workers);
+            ifstream in(path);
+            Timer timer;
+            matcher.addGenomes(in);
+            record(results, genomeCount, k, "ingest", timer.seconds(), bases, "bases", 0);
+        }
+
+        GenomeMatcher matcher(k, config.index);
+        matcher.setWorkerCount(config.workers);
+        matcher.setResultCacheSize(config.cacheBytes);
+        Timer buildTimer;
+        matcher.addGenomes(genomes);
+        record(results, genomeCount, k, "addGenomes", buildTimer.seconds(), bases, "bases", 0);
+
+        vector<string> queries = makeQueries(genomes, config.queries, fragmentLength, rng);
+        for (int exact = 1; exact >= 0; exact--) {
+            string mode = exact ? "exact" : "snp";
+            matcher.resetStats();
+            Timer timer;
+            long hits = runFinds(matcher, queries, k, exact);
+            record(results, genomeCount, k, "find_" + mode, timer.seconds(), static_cast<double>(queries.size()), "queries", hits, matcher.stats());
+
+            matcher.resetStats();
+            Timer batchTimer;
+            hits = runBatch(matcher, queries, k, exact);
+            record(results, genomeCount, k, "find_batch_" + mode, batchTimer.seconds(), static_cast<double>(queries.size()), "queries", hits, matcher.stats());
+            
+            if (matcher.stats().enabled) {
+                Timer steadyTimer;
+                MatcherStats steady = steadyFinds(matcher, queries, k, exact, hits);
+                record(results, genomeCount, k, "find_steady_" + mode, steadyTimer.seconds(), 2.0 * queries.size(), "queries", hits, steady);
+                if (steady.allocations > 0) {
+                    cerr << "find_steady_" << mode << ": " << steady.allocations << " allocations in warmed-up queries" << endl;
+                    allocatingPhases++;
+                }
+            }
+        }
+
+            // a fresh relative of the reference, matched fragment by fragment against the library
+        Genome query("query", Synthetic::mutate(reference, config.data, rng));
+        for (int exact = 1; exact >= 0; exact--) {
+            vector<GenomeMatch> related;
+            matcher.resetStats();
+            Timer timer;
+            matcher.findRelatedGenomes(query, fragmentLength, exact, 0.0, related);
+            record(results, genomeCount, k, exact ? "related_exact" : "related_snp", timer.seconds(), query.length(), "bases", static_cast<long>(related.size()), matcher.stats());
+            
+                // the single best relative, with genomes dropped once they can't catch up
+            matcher.resetStats();
+            Timer topTimer;
+            matcher.findRelatedGenomes(query, fragmentLength, exact, 0.0, 1, related);
+            record(results, genomeCount, k, exact ? "related_top1_exact" : "related_top1_snp", topTimer.seconds(), query.length(), "bases", static_cast<long>(related.size()), matcher.stats());
+        }
+        if (config.index.sketchScale > 0) {
+            vector<GenomeMatch> related;
+            Timer timer;
+            matcher.estimateRelatedGenomes(query, fragmentLength, 0.0, related);
+            record(results, genomeCount, k, "related_estimate", timer.seconds(), query.length(), "bases", static_cast<long>(related.size()));
+        }
+        
+            // readers querying while each genome is added again under another name and removed
+        {
+            atomic<bool> writing(true);
+            atomic<long> finds(0), hits(0);
+            vector<thread> readers;
+            for (int r = 0; r < max(config.workers, 1); r++)
+                readers.push_back(thread([&, r]() {
+                    vector<DNAMatch> matches;
+                    for (size_t i = r; writing; i = (i + 1) % queries.size()) {
+                        if (matcher.findGenomesWithThisDNA(queries[i], k, true, matches))
+                            hits += matches.size();
+                        finds++;
+                    }
+                }));
+            Timer timer;
+            string sequence;
+            for (size_t i = 0; i < genomes.size(); i++) {
+                genomes[i].extract(0, genomes[i].length(), sequence);
+                matcher.addGenome(Genome("extra_" + to_string(i), sequence));
+                matcher.removeGenome("extra_" + to_string(i));
+            }
+            writing = false;
+            for (size_t r = 0; r < readers.size(); r++)
+                readers[r].join();
+            double seconds = timer.seconds();
+            record(results, genomeCount, k, "mixed_find", seconds, static_cast<double>(finds), "queries", hits);
+            record(results, genomeCount, k, "mixed_write", seconds, 2.0 * genomes.size(), "changes", 0);
+        }
+    }
+    remove(path);
+}
+
+void writeJson(ostream& out, const Config& config, const vector<Result>& results)
+{
+    out << "{\n  \"config\": {"
+        << "\"genomeLength\": " << config.data.length
+        << ", \"gcContent\": " << config.data.gcContent
+        << ", \"nDensity\": " << config.data.nDensity
+        << ", \"mutationRate\": " << config.data.mutationRate
+        << ", \"seed\": " << config.data.seed
+        << ", \"queries\": " << config.queries
+        << ", \"fragmentLength\": " << config.fragmentLength
+        << ", \"workers\": " << config.workers
+        << ", \"index\": \"" << (config.index.indexMode == MatcherOptions::FM_INDEX ? "fm" : config.index.indexMode == MatcherOptions::MINIMIZERS ? "minimizers" : "kmers") << "\""
+        << ", \"minimizerWindow\": " << (config.index.indexMode == MatcherOptions::MINIMIZERS ? config.index.minimizerWindow : 0)
+        << ", \"cacheBytes\": " << config.cacheBytes
+        << ", \"sketchScale\": " << config.index.sketchScale
+        << "},\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << "    {\"genomes\": " << r.genomes
+            << ", \"minSearchLength\": " << r.minSearchLength
+            << ", \"phase\": \"" << r.phase << "\""
+            << ", \"seconds\": " << setprecision(6) << r.seconds
+            << ", \"items\": " << setprecision(0) << fixed << r.items << defaultfloat
+            << ", \"unit\": \"" << r.unit << "\""
+            << ", \"perSecond\": " << setprecision(6) << (r.seconds > 0 ? r.items / r.seconds : 0)
+            << ", \"hits\": " << r.hits
+            << ", \"peakRssKB\": " << r.peakRssKB;
+        const MatcherStats& st = r.stats;
+        if (st.cacheHits + st.cacheMisses > 0)
+            out << ", \"cacheHits\": " << st.cacheHits << ", \"cacheMisses\": " << st.cacheMisses;
+        if (st.enabled)
+            out << ", \"stats\": {\"queries\": " << st.queries
+                << ", \"trieNodesVisited\": " << st.trieNodesVisited
+                << ", \"postingsReturned\": " << st.postingsReturned
+                << ", \"candidatesVerified\": " << st.candidatesVerified
+                << ", \"candidatesAccepted\": " << st.candidatesAccepted
+                << ", \"extractCalls\": " << st.extractCalls
+                << ", \"extractBytes\": " << st.extractBytes
+                << ", \"allocations\": " << st.allocations
+                << ", \"descentSeconds\": " << st.descentSeconds
+                << ", \"verifySeconds\": " << st.verifySeconds << "}";
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+    Config config;
+    if (!parseArgs(argc, argv, config)) {
+        usage();
+        return 1;
+    }
+
+    cerr << setw(8) << "genomes" << setw(6) << "k" << "  " << left << setw(22) << "phase" << right
+         << setw(12) << "time" << setw(24) << "throughput" << setw(15) << "found" << setw(13) << "peak RSS" << endl;
+    vector<Result> results;
+    for (int count : config.genomeCounts)
+        if (count > 0)
+            benchmark(config, count, results);
+
+    if (config.jsonPath.empty())
+        writeJson(cout, config, results);
+    else {
+        ofstream out(config.jsonPath);
+        writeJson(out, config, results);
+        if (!out) {
+            cerr << "cannot write " << config.jsonPath << endl;
+            return 1;
+        }
+    }
+    return allocatingPhases == 0 ? 0 : 1;
+}
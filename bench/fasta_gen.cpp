@@ -0,0 +1,75 @@
+#include "Synthetic.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+using namespace std;
+
+// Writes a synthetic FASTA file: one random reference genome followed by
+// mutated copies of it.
+//
+//   fasta_gen [--genomes N] [--length BASES] [--gc F] [--n-density F]
+//             [--mutation-rate F] [--seed S] [--output PATH]
+
+void usage()
+{
+    cerr << "usage: fasta_gen [--genomes N] [--length BASES] [--gc F] [--n-density F]" << endl
+         << "                 [--mutation-rate F] [--seed S] [--output PATH]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    Synthetic::Options options;
+    options.mutationRate = 0.01;
+    int genomes = 1;
+    string output;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--genomes")
+            genomes = atoi(value.c_str());
+        else if (arg == "--length")
+            options.length = strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--gc")
+            options.gcContent = atof(value.c_str());
+        else if (arg == "--n-density")
+            options.nDensity = atof(value.c_str());
+        else if (arg == "--mutation-rate")
+            options.mutationRate = atof(value.c_str());
+        else if (arg == "--seed")
+            options.seed = strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--output")
+            output = value;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (genomes < 1 || options.length == 0) {
+        usage();
+        return 1;
+    }
+
+    ofstream file;
+    if (!output.empty()) {
+        file.open(output);
+        if (!file) {
+            cerr << "cannot write " << output << endl;
+            return 1;
+        }
+    }
+    ostream& out = output.empty() ? cout : file;
+
+    mt19937_64 rng(options.seed);
+    string reference = Synthetic::randomSequence(options, rng);
+    Synthetic::writeFasta(out, "reference", reference);
+    for (int g = 1; g < genomes; g++)
+        Synthetic::writeFasta(out, "mutant_" + to_string(g), Synthetic::mutate(reference, options, rng));
+
+    return out ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+#include "provided.h"
+#include "ShardedMatcher.h"
+#include "Synthetic.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+using namespace std;
+
+// Runs a ShardedMatcher (one worker process per shard) next to a single GenomeMatcher
+// over the same synthetic genomes and checks that every answer is identical: single
+// and batched finds, findRelatedGenomes with and without a result limit, and the
+// same again after genomes are replaced and removed. Prints what differs and the
+// time each side took; exits non-zero on any difference.
+//
+//   shard_harness [--shards N] [--genomes N] [--length BASES] [--k K] [--queries N]
+//                 [--workers N] [--mutation-rate F] [--seed S] [--both-strands 0|1]
+
+struct Config
+{
+    int shards = 4;
+    int genomes = 12;
+    int minSearchLength = 12;
+    int queries = 500;
+    int workers = 1;
+    MatcherOptions options;
+    Synthetic::Options data;
+};
+
+void usage()
+{
+    cerr << "usage: shard_harness [--shards N] [--genomes N] [--length BASES] [--k K] [--queries N]" << endl
+         << "                     [--workers N] [--mutation-rate F] [--seed S] [--both-strands 0|1]" << endl;
+}
+
+bool parseArgs(int argc, char* argv[], Config& config)
+{
+    config.data.length = 50000;
+    config.data.nDensity = 0.001;
+    config.data.mutationRate = 0.02;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        string value = argv[++i];
+        if (arg == "--shards")
+            config.shards = atoi(value.c_str());
+        else if (arg == "--genomes")
+            config.genomes = atoi(value.c_str());
+        else if (arg == "--length")
+            config.data.length = strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--k")
+            config.minSearchLength = atoi(value.c_str());
+        else if (arg == "--queries")
+            config.queries = atoi(value.c_str());
+        else if (arg == "--workers")
+            config.workers = atoi(value.c_str());
+        else if (arg == "--mutation-rate")
+            config.data.mutationRate = atof(value.c_str());
+        else if (arg == "--seed")
+            config.data.seed = strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--both-strands")
+            config.options.bothStrands = atoi(value.c_str()) != 0;
+        else
+            return false;
+    }
+    return config.shards > 0 && config.genomes > 0 && config.minSearchLength > 0 && config.data.length > 0;
+}
+
+class Timer
+{
+public:
+    Timer() : m_start(chrono::steady_clock::now()) {}
+    double seconds() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - m_start).count();
+    }
+private:
+    chrono::steady_clock::time_point m_start;
+};
+
+int differences = 0;
+
+void differs(const string& what)
+{
+    if (differences++ < 20)
+        cerr << "DIFFERENT: " << what << endl;
+}
+
+bool same(const vector<DNAMatch>& x, const vector<DNAMatch>& y)
+{
+    if (x.size() != y.size())
+        return false;
+    for (size_t i = 0; i < x.size(); i++)
+        if (x[i].genomeName != y[i].genomeName || x[i].length != y[i].length || x[i].position != y[i].position ||
+            x[i].reverseStrand != y[i].reverseStrand)
+            return false;
+    return true;
+}
+
+bool same(const vector<GenomeMatch>& x, const vector<GenomeMatch>& y)
+{
+    if (x.size() != y.size())
+        return false;
+    for (size_t i = 0; i < x.size(); i++)
+        if (x[i].genomeName != y[i].genomeName || x[i].percentMatch != y[i].percentMatch)
+            return false;
+    return true;
+}
+
+    // fragments of random genomes, one base changed in every other one, some in lower case
+vector<string> makeQueries(const vector<Genome>& genomes, int count, int length, mt19937_64& rng)
+{
+    vector<string> queries;
+    string fragment;
+    for (int i = 0; i < count; i++) {
+        const Genome& g = genomes[rng() % genomes.size()];
+        if (g.length() < length)
+            continue;
+        g.extract(static_cast<int>(rng() % (g.length() - length + 1)), length, fragment);
+        if (rng() % 2)
+            fragment[rng() % length] = "ACGTN"[rng() % 5];
+        if (rng() % 16 == 0)
+            fragment[rng() % length] = 'a';
+        queries.push_back(fragment);
+    }
+    return queries;
+}
+
+void compare(const string& stage, const Config& config, const GenomeMatcher& single, const ShardedMatcher& sharded, const vector<Genome>& genomes, const Genome& query, mt19937_64& rng)
+{
+    int k = config.minSearchLength;
+    vector<string> queries = makeQueries(genomes, config.queries, 2 * k, rng);
+    double singleSeconds = 0, shardedSeconds = 0;
+
+    for (int exact = 1; exact >= 0; exact--) {
+        for (size_t i = 0; i < queries.size(); i++) {
+            vector<DNAMatch> x, y;
+            Timer a;
+            bool rx = single.findGenomesWithThisDNA(queries[i], k + i % 3, exact, x);
+            singleSeconds += a.seconds();
+            Timer b;
+            bool ry = sharded.findGenomesWithThisDNA(queries[i], k + i % 3, exact, y);
+            shardedSeconds += b.seconds();
+            if (rx != ry || (rx && !same(x, y)))
+                differs(stage + " find " + queries[i]);
+        }
+
+        vector<vector<DNAMatch>> x, y;
+        Timer a;
+        bool rx = single.findGenomesWithThisDNA(queries, k, exact, x);
+        singleSeconds += a.seconds();
+        Timer b;
+        bool ry = sharded.findGenomesWithThisDNA(queries, k, exact, y);
+        shardedSeconds += b.seconds();
+        if (rx != ry || x.size() != y.size())
+            differs(stage + " batch");
+        for (size_t i = 0; i < x.size() && i < y.size(); i++)
+            if (!same(x[i], y[i]))
+                differs(stage + " batch " + queries[i]);
+
+        double thresholds[] = { 0.0, 5.0, 50.0 };
+        for (double threshold : thresholds)
+            for (int maxResults = 0; maxResults <= 2; maxResults += 2) {
+                vector<GenomeMatch> rx, ry;
+                Timer a;
+                bool fx = single.findRelatedGenomes(query, 2 * k, exact, threshold, maxResults, rx);
+                singleSeconds += a.seconds();
+                Timer b;
+                bool fy = sharded.findRelatedGenomes(query, 2 * k, exact, threshold, maxResults, ry);
+                shardedSeconds += b.seconds();
+                if (fx != fy || (fx && !same(rx, ry)))
+                    differs(stage + " related, threshold " + to_string(threshold) + ", top " + to_string(maxResults));
+            }
+    }
+    cerr << stage << ": single " << singleSeconds << " s, " << config.shards << " shards " << shardedSeconds << " s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    Config config;
+    if (!parseArgs(argc, argv, config)) {
+        usage();
+        return 1;
+    }
+
+    mt19937_64 rng(config.data.seed);
+    string reference = Synthetic::randomSequence(config.data, rng);
+    vector<Genome> genomes;
+    for (int i = 0; i < config.genomes; i++)
+        genomes.push_back(Genome("genome" + to_string(i), i == 0 ? reference : Synthetic::mutate(reference, config.data, rng)));
+    Genome query("query", Synthetic::mutate(reference, config.data, rng));
+
+    GenomeMatcher single(config.minSearchLength, config.options);
+    ShardedMatcher sharded(config.minSearchLength, config.shards, config.options);
+    single.setWorkerCount(config.workers);
+    sharded.setWorkerCount(config.workers);
+    if (!sharded.ok()) {
+        cerr << "could not start the shard processes" << endl;
+        return 1;
+    }
+
+        // half in one batch, the rest one at a time
+    int half = config.genomes / 2;
+    vector<Genome> first(genomes.begin(), genomes.begin() + half);
+    single.addGenomes(first);
+    sharded.addGenomes(first);
+    for (size_t i = half; i < genomes.size(); i++) {
+        single.addGenome(genomes[i]);
+        sharded.addGenome(genomes[i]);
+    }
+    compare("initial", config, single, sharded, genomes, query, rng);
+
+        // re-adding a name moves it to another shard; removing drops it everywhere
+    for (size_t i = 0; i < genomes.size(); i += 3) {
+        genomes[i] = Genome(genomes[i].name(), Synthetic::mutate(reference, config.data, rng));
+        single.addGenome(genomes[i]);
+        sharded.addGenome(genomes[i]);
+    }
+    vector<Genome> live;
+    for (size_t i = 0; i < genomes.size(); i++) {
+        if (i % 4 == 1) {
+            if (single.removeGenome(genomes[i].name()) != sharded.removeGenome(genomes[i].name()))
+                differs("removeGenome " + genomes[i].name());
+        }
+        else
+            live.push_back(genomes[i]);
+    }
+    if (!live.empty())
+        compare("after replace/remove", config, single, sharded, live, query, rng);
+
+    if (!sharded.ok()) {
+        cerr << "a shard stopped answering" << endl;
+        return 1;
+    }
+    cerr << (differences == 0 ? "identical" : to_string(differences) + " differences") << endl;
+    return differences == 0 ? 0 : 1;
+}
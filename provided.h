@@ -0,0 +1,188 @@
+#ifndef PROVIDED_INCLUDED
+#define PROVIDED_INCLUDED
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <memory>
+#include <functional>
+
+class GenomeImpl;
+
+class Genome
+{
+public:
+      // extract() gives sequence back exactly as passed. Matching reads a lower-case base as
+      // its upper-case one and any character other than ACGT as N.
+    Genome(const std::string& nm, const std::string& sequence);
+    ~Genome();
+      // A Genome never changes once built, so copies share one sequence buffer (reference
+      // counted) and cost no more than a pointer copy. A moved-from Genome may only be
+      // assigned to or destroyed.
+    Genome(const Genome& other);
+    Genome(Genome&& other) noexcept;
+    Genome& operator=(const Genome& rhs);
+    Genome& operator=(Genome&& rhs) noexcept;
+    static bool load(std::istream& genomeSource, std::vector<Genome>& genomes);
+      // Same records, each handed to add as soon as it has been read rather than collected.
+      // On malformed input it stops and returns false; the records before it have been added.
+    static bool load(std::istream& genomeSource, const std::function<void(Genome&&)>& add);
+      // Same as above for a FASTA file on disk, mapped and parsed in parallel.
+    static bool load(const std::string& path, std::vector<Genome>& genomes);
+    int length() const;
+    std::string name() const;
+    bool extract(int position, int length, std::string& fragment) const;
+      // Same, decoding into length chars at fragment, so nothing is allocated.
+    bool extract(int position, int length, char* fragment) const;
+      // Up to 32 bases starting at position in the PackedDNA.h layout; returns
+      // how many bases were filled in (0 if position is out of range).
+    int packedWord(int position, uint64_t& bases, uint64_t& nMask) const;
+      // Writes the packed sequence and name as one 8-byte aligned block and returns its
+      // size; mapPacked serves a Genome straight from such a block (e.g. in a mapped
+      // file) without copying it, as long as owner keeps the memory alive. It sets genome
+      // and returns true only if the block is well formed and fits in its bytes; without
+      // checkRuns only the sizes are checked, not the order of the runs of N within.
+    size_t writePacked(std::ostream& out) const;
+    static bool mapPacked(const char* block, size_t bytes, std::shared_ptr<const void> owner, Genome& genome, bool checkRuns = true);
+
+private:
+    std::shared_ptr<const GenomeImpl> m_impl;
+    Genome(const GenomeImpl* impl);
+};
+
+struct DNAMatch
+{
+    std::string genomeName;
+    int length;
+    int position;
+    bool reverseStrand;     // the fragment matched the reverse complement of [position, position + length)
+};
+
+struct GenomeMatch
+{
+    std::string genomeName;
+    double percentMatch;
+};
+
+  // Totals of GenomeMatcher::stats(); all zero unless built with GENOMICS_STATS, except
+  // the result cache's hits and misses, which are always kept (a miss only counts when
+  // the result is then cached).
+  // Every fragment findRelatedGenomes tries counts as one query.
+struct MatcherStats
+{
+    bool enabled;
+    uint64_t queries;
+    uint64_t trieNodesVisited;
+    uint64_t postingsReturned;
+    uint64_t candidatesVerified;
+    uint64_t candidatesAccepted;
+    uint64_t extractCalls;
+    uint64_t extractBytes;
+    uint64_t allocations;
+    double descentSeconds;
+    double verifySeconds;
+    uint64_t cacheHits;
+    uint64_t cacheMisses;
+};
+
+  // How a GenomeMatcher indexes its genomes. ALL_KMERS keeps a posting for every position;
+  // MINIMIZERS keeps only the (w,k)-minimizers, about 2/(w+1) of them, and still finds
+  // every match at least minSearchLength + minimizerWindow - 1 bases long (shorter ones
+  // can be missed). FM_INDEX replaces the k-mer trie with an FM-index of all the genomes
+  // (about a byte per base) that searches a fragment's whole minimumLength prefix; it is
+  // rebuilt whenever genomes are added (a saved library keeps its index), each rebuild
+  // taking some 25 bytes of scratch per base of the library, and addGenomes(istream&)
+  // buffers its whole input for a single rebuild at the end.
+  // Each addition is indexed on its own and merged with earlier ones in the background.
+  // Removed genomes stop matching at once; their postings are purged in the background once
+  // they make up compactionThreshold of the indexed bases, rewriting only the additions that
+  // hold the most of them until the share is back under the threshold.
+  // With sketchScale s > 0 every genome also gets a FracMinHash sketch of about 1/s of its
+  // k-mers. findRelatedGenomes then skips genomes whose sketch shows they can't get near
+  // the threshold (a genome just above it may rarely be missed; with s = 1 none is), and
+  // estimateRelatedGenomes answers from the sketches alone.
+  // With bothStrands (ALL_KMERS only) each k-mer is indexed under the lesser of itself and
+  // its reverse complement, so the index is no larger, and a fragment matches either strand
+  // of a genome; a reverse-strand match's position is where it starts on the forward strand.
+  // The other modes search the forward strand only.
+struct MatcherOptions
+{
+    enum IndexMode { ALL_KMERS, MINIMIZERS, FM_INDEX };
+    IndexMode indexMode = ALL_KMERS;
+    int minimizerWindow = 8;
+    double compactionThreshold = 0.25;
+    int sketchScale = 0;
+    bool bothStrands = false;
+};
+
+class GenomeMatcherImpl;
+
+class GenomeMatcher
+{
+public:
+    GenomeMatcher(int minSearchLength);
+    GenomeMatcher(int minSearchLength, const MatcherOptions& options);
+    ~GenomeMatcher();
+      // Queries may run on any number of threads while one of these changes the library; each
+      // query sees the library as it was before or after a change, never part way through,
+      // and never waits for the change to finish.
+    void addGenome(const Genome& genome);
+      // Indexes a whole batch at once; much faster than one addGenome call each.
+    void addGenomes(const std::vector<Genome>& genomes);
+      // Adds every genome of a FASTA source, as Genome::load reads them, parsing, indexing and
+      // inserting batches side by side on several threads; memory for the batches in flight
+      // stays bounded however large the input, and each batch becomes visible to queries as
+      // it's done. Not so in FM_INDEX mode, which can't index a batch at a time: every genome
+      // of the input is held, unsearchable, until the end, when one rebuild over the whole
+      // library needs its scratch, so memory grows with the input. False if the input is
+      // malformed; the genomes before that are still added.
+    bool addGenomes(std::istream& fasta);
+      // removeGenome drops the genome with this name; replaceGenome swaps in a new genome for
+      // the one with the same name. Both return false (and change nothing) if there is none.
+    bool removeGenome(const std::string& name);
+    bool replaceGenome(const Genome& genome);
+    int minimumSearchLength() const;
+      // Threads findRelatedGenomes and batched finds may spread their work over (default 1).
+    void setWorkerCount(int workers);
+      // Keeps up to bytes of recent fragment results so repeated fragments skip the search;
+      // findRelatedGenomes' fragments use them too but, searching only some genomes, add
+      // none. 0, the default, turns it off. Any change to the library empties it.
+    void setResultCacheSize(size_t bytes);
+    bool findGenomesWithThisDNA(const std::string& fragment, int minimumLength, bool exactMatchOnly, std::vector<DNAMatch>& matches) const;
+      // Batched form: matches[i] is what the call above gives for fragments[i] (empty where it
+      // returns false). Fragments sharing a prefix share one index lookup. True if any matched.
+    bool findGenomesWithThisDNA(const std::vector<std::string>& fragments, int minimumLength, bool exactMatchOnly, std::vector<std::vector<DNAMatch>>& matches) const;
+    bool findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, std::vector<GenomeMatch>& results) const;
+      // The first maxResults of the above (all of them if maxResults <= 0), found without
+      // checking genomes any further once they can no longer make the cut.
+    bool findRelatedGenomes(const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, int maxResults, std::vector<GenomeMatch>& results) const;
+      // Sketch-only triage: percentMatch is the estimated share of the k-mers in query's
+      // fragments that each genome has, which bounds findRelatedGenomes' exact-match
+      // percentage from above (strictly with sketchScale 1, up to sampling error otherwise).
+      // False if the library keeps no sketches.
+    bool estimateRelatedGenomes(const Genome& query, int fragmentMatchLength, double matchPercentThreshold, std::vector<GenomeMatch>& results) const;
+      // save writes the genomes and index to a versioned, checksummed file. open maps such a
+      // file read-only and answers queries from it straight away. It returns nullptr if the
+      // file can't be used: by default that's checked from the header and each genome's
+      // block size alone, so opening takes time in the number of genomes, not the size of
+      // the index. verifyChecksum also compares the data checksum and checks everything
+      // queries follow (genome blocks, the trie or FM-index, every posting list), reading the
+      // whole file; only a verified file is safe to open if it may be damaged.
+    bool save(const std::string& path) const;
+    static GenomeMatcher* open(const std::string& path, bool verifyChecksum = false);
+      // Counters of the work queries have done since construction or resetStats().
+    MatcherStats stats() const;
+    void resetStats();
+      // We prevent a GenomeMatcher object from being copied or assigned.
+    GenomeMatcher(const GenomeMatcher&) = delete;
+    GenomeMatcher& operator=(const GenomeMatcher&) = delete;
+
+private:
+    GenomeMatcherImpl* m_impl;
+    GenomeMatcher(GenomeMatcherImpl* impl);
+};
+
+#endif // PROVIDED_INCLUDED
@@ -0,0 +1,125 @@
+#include "provided.h"
+#include "Stats.h"
+#include "Synthetic.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+using namespace std;
+
+// Checks that a warmed-up findGenomesWithThisDNA allocates nothing: each query runs once
+// so the thread's scratch and its result vector grow to fit, then repeatedly while the
+// operator new of Stats.cpp counts every allocation on the thread, on two threads at once.
+// Genome names are longer than std::string's own buffer, so copying one into a result
+// that didn't hold it before would show. Covers exact and SNiP lookups, result cache hits,
+// both-strand matching and each index mode. Built against an instrumented copy of the
+// library, so it runs whether or not GENOMICS_STATS is on.
+
+int failures = 0;
+
+    // genome names start with this, which no std::string holds without allocating
+const string LONG_NAME = "a genome name too long for the small-string buffer #";
+
+uint64_t allocations()
+{
+    return Stats::threadCounters.values[Stats::ALLOCATIONS];
+}
+
+void check(const string& name, const MatcherOptions& options, size_t cacheBytes)
+{
+    const int k = 12;
+    mt19937_64 rng(20240607);
+    Synthetic::Options data;
+    data.length = 20000;
+    data.nDensity = 0.001;
+    data.mutationRate = 0.01;
+    string reference = Synthetic::randomSequence(data, rng);
+
+        // one batch, one segment: a background compaction would publish a new snapshot and
+        // empty the result cache part way through
+    GenomeMatcher matcher(k, options);
+    matcher.setResultCacheSize(cacheBytes);
+    vector<Genome> genomes;
+    for (int g = 0; g < 4; g++)
+        genomes.push_back(Genome(LONG_NAME + to_string(g), Synthetic::mutate(reference, data, rng)));
+    matcher.addGenomes(genomes);
+
+        // fragments of the reference, some with a SNiP, and some that match nothing
+    vector<string> queries;
+    for (int i = 0; i < 200; i++) {
+        string fragment = reference.substr(rng() % (reference.size() - 2 * k), 2 * k);
+        if (i % 3 == 0)
+            fragment[k + rng() % k] = "ACGT"[rng() % 4];
+        if (i % 10 == 0)
+            fragment = Synthetic::randomSequence(Synthetic::Options{ size_t(2 * k), 0.5, 0.0, 0.0, rng() }, rng);
+        queries.push_back(fragment);
+    }
+
+        // runs every query once so this thread's scratch and its result vector grow to fit,
+        // then three more times counting; results vary between 0 and 4 genomes, so the vector
+        // keeps shedding and regrowing entries
+    auto measure = [&](bool exact, uint64_t& counted, long& hits) {
+        vector<DNAMatch> matches;
+        for (const string& fragment : queries)
+            matcher.findGenomesWithThisDNA(fragment, k, exact, matches);
+        uint64_t before = allocations();
+        hits = 0;
+        for (int round = 0; round < 3; round++)
+            for (const string& fragment : queries)
+                if (matcher.findGenomesWithThisDNA(fragment, k, exact, matches))
+                    hits += matches.size();
+        counted = allocations() - before;
+    };
+
+        // on two threads at once, each counting its own allocations
+    for (int exact = 1; exact >= 0; exact--) {
+        uint64_t counted[2];
+        long hits[2];
+        thread other([&]() { measure(exact, counted[1], hits[1]); });
+        measure(exact, counted[0], hits[0]);
+        other.join();
+        for (int t = 0; t < 2; t++)
+            if ((counted[t] != 0 || hits[t] == 0) && failures++ < 20)
+                cerr << "FAIL: " << name << (exact ? " exact" : " snp") << ", thread " << t << ": " << counted[t] << " allocations, " << hits[t] << " hits" << endl;
+    }
+}
+
+int main()
+{
+        // make sure the hook is live: this has to count (the pointer escapes so the pair
+        // can't be optimised away)
+    static int* volatile escaped;
+    uint64_t before = allocations();
+    escaped = new int(0);
+    delete escaped;
+    if (allocations() == before) {
+        cerr << "FAIL: operator new is not counting allocations" << endl;
+        return 1;
+    }
+
+    if (LONG_NAME.size() <= string().capacity()) {
+        cerr << "FAIL: genome names fit in std::string's own buffer" << endl;
+        return 1;
+    }
+
+    MatcherOptions options;
+    check("ALL_KMERS", options, 0);
+    check("ALL_KMERS cached", options, 1 << 20);
+    options.bothStrands = true;
+    check("ALL_KMERS both strands", options, 0);
+    check("ALL_KMERS both strands cached", options, 1 << 20);
+    options.bothStrands = false;
+    options.indexMode = MatcherOptions::MINIMIZERS;
+    options.minimizerWindow = 4;
+    check("MINIMIZERS", options, 0);
+    options.indexMode = MatcherOptions::FM_INDEX;
+    check("FM_INDEX", options, 0);
+
+    if (failures > 0) {
+        cerr << failures << " failures" << endl;
+        return 1;
+    }
+    cout << "warmed-up queries allocate nothing" << endl;
+    return 0;
+}
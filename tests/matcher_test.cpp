@@ -0,0 +1,394 @@
+#include "provided.h"
+#include "Synthetic.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <unistd.h>
+using namespace std;
+
+// Checks GenomeMatcher against a brute-force search over the same genomes: single and
+// batched findGenomesWithThisDNA (exact and one-SNiP) and findRelatedGenomes, in each
+// index mode, with and without both-strand matching, after genomes are removed and
+// replaced (with compaction merging segments behind the queries), and again on the
+// library saved and opened from a file; and findRelatedGenomes with each result limit
+// against the first results of an unlimited call. Then the sketch prefilter and
+// estimateRelatedGenomes against the exhaustive search. Exits non-zero on any difference.
+
+int failures = 0;
+
+void fail(const string& what)
+{
+    if (failures++ < 20)
+        cerr << "FAIL: " << what << endl;
+}
+
+    // a library as the brute-force search sees it: name and bases, in the order added
+struct Reference
+{
+    vector<pair<string, string>> genomes;
+    bool bothStrands = false;
+};
+
+string reverseComplement(const string& s)
+{
+    string r(s.rbegin(), s.rend());
+    for (char& c : r)
+        c = c == 'A' ? 'T' : c == 'C' ? 'G' : c == 'G' ? 'C' : c == 'T' ? 'A' : c;
+    return r;
+}
+
+    // the best match per genome, as GenomeMatcher defines it: longest, then earliest, then
+    // forward; the whole fragment must fit in the genome along the strand it matches on
+bool referenceFind(const Reference& ref, const string& fragment, int minimumLength, bool exactMatchOnly, vector<DNAMatch>& matches)
+{
+    matches.clear();
+    int L = static_cast<int>(fragment.size());
+    for (const auto& genome : ref.genomes) {
+        const string& forward = genome.second;
+        string reverse = reverseComplement(forward);
+        int n = static_cast<int>(forward.size());
+        DNAMatch best = { genome.first, -1, 0, false };
+        for (int strand = 0; strand < (ref.bothStrands ? 2 : 1); strand++) {
+            const string& s = strand == 0 ? forward : reverse;
+            for (int p = 0; p + L <= n; p++) {
+                int length = 0, mismatches = 0;
+                for (; length < L; length++)
+                    if (s[p + length] != fragment[length] && (exactMatchOnly || length == 0 || mismatches++ == 1))
+                        break;
+                if (length < minimumLength)
+                    continue;
+                int position = strand == 0 ? p : n - p - length;
+                if (length > best.length || (length == best.length && (position < best.position ||
+                    (position == best.position && best.reverseStrand && strand == 0))))
+                    best = { genome.first, length, position, strand == 1 };
+            }
+        }
+        if (best.length >= 0)
+            matches.push_back(best);
+    }
+    return !matches.empty();
+}
+
+bool referenceRelated(const Reference& ref, const Genome& query, int fragmentMatchLength, bool exactMatchOnly, double matchPercentThreshold, vector<GenomeMatch>& results)
+{
+    results.clear();
+    int S = query.length() / fragmentMatchLength;
+    map<string, int> counts;
+    for (int i = 0; i < S; i++) {
+        string fragment;
+        vector<DNAMatch> matches;
+        query.extract(i * fragmentMatchLength, fragmentMatchLength, fragment);
+        referenceFind(ref, fragment, fragmentMatchLength, exactMatchOnly, matches);
+        for (const DNAMatch& m : matches)
+            counts[m.genomeName]++;
+    }
+    for (const auto& c : counts)
+        if (c.second * 100.0 / S >= matchPercentThreshold)
+            results.push_back({ c.first, c.second * 100.0 / S });
+    sort(results.begin(), results.end(), [](const GenomeMatch& x, const GenomeMatch& y) {
+        return x.percentMatch != y.percentMatch ? x.percentMatch > y.percentMatch : x.genomeName < y.genomeName;
+    });
+    return !results.empty();
+}
+
+string describe(const vector<DNAMatch>& matches)
+{
+    ostringstream out;
+    for (const DNAMatch& m : matches)
+        out << " " << m.genomeName << ":" << m.length << "@" << m.position << (m.reverseStrand ? "-" : "+");
+    return out.str();
+}
+
+string describe(const vector<GenomeMatch>& matches)
+{
+    ostringstream out;
+    for (const GenomeMatch& m : matches)
+        out << " " << m.genomeName << ":" << m.percentMatch;
+    return out.str();
+}
+
+bool same(const vector<DNAMatch>& x, const vector<DNAMatch>& y)
+{
+    if (x.size() != y.size())
+        return false;
+    for (size_t i = 0; i < x.size(); i++)
+        if (x[i].genomeName != y[i].genomeName || x[i].length != y[i].length || x[i].position != y[i].position ||
+            x[i].reverseStrand != y[i].reverseStrand)
+            return false;
+    return true;
+}
+
+struct Config
+{
+    string name;
+    int minSearchLength;
+    MatcherOptions options;
+    int shortest;           // the shortest minimumLength this mode finds every match for
+};
+
+void compare(const string& stage, const Config& config, const GenomeMatcher& matcher, const Reference& ref, const vector<string>& fragments, const Genome& query)
+{
+    for (int exact = 0; exact < 2; exact++) {
+        int minimumLength = config.shortest + (exact ? 0 : 3);
+        vector<vector<DNAMatch>> batched;
+        matcher.findGenomesWithThisDNA(fragments, minimumLength, exact, batched);
+        for (size_t i = 0; i < fragments.size(); i++) {
+            vector<DNAMatch> got, want;
+            bool found = matcher.findGenomesWithThisDNA(fragments[i], minimumLength, exact, got);
+            bool expected = referenceFind(ref, fragments[i], minimumLength, exact, want);
+            string where = config.name + " " + stage + (exact ? " exact " : " snp ") + fragments[i];
+            if (found != expected || (expected && !same(got, want)))
+                fail(where + "\n  got " + describe(got) + "\n  want" + describe(want));
+            if (!same(batched[i], expected ? want : vector<DNAMatch>()))
+                fail(where + " (batched)\n  got " + describe(batched[i]) + "\n  want" + describe(want));
+        }
+
+        vector<GenomeMatch> got, want;
+        int fragmentMatchLength = config.shortest + 2;
+        bool found = matcher.findRelatedGenomes(query, fragmentMatchLength, exact, 5, got);
+        bool expected = referenceRelated(ref, query, fragmentMatchLength, exact, 5, want);
+        bool equal = got.size() == want.size();
+        for (size_t i = 0; equal && i < got.size(); i++)
+            equal = got[i].genomeName == want[i].genomeName && fabs(got[i].percentMatch - want[i].percentMatch) < 1e-9;
+        if (found != expected || (expected && !equal))
+            fail(config.name + " " + stage + (exact ? " exact" : " snp") + " findRelatedGenomes\n  got " + describe(got) + "\n  want" + describe(want));
+    }
+}
+
+    // findRelatedGenomes limited to each K returns the first K of its unlimited results; the
+    // query is long enough to take several rounds of fragments, so genomes are dropped part way
+void compareTopK(const string& stage, const Config& config, const GenomeMatcher& matcher, const Genome& query, int genomes)
+{
+    int fragmentMatchLength = config.shortest + 2;
+    for (int exact = 0; exact < 2; exact++) {
+        vector<GenomeMatch> all;
+        matcher.findRelatedGenomes(query, fragmentMatchLength, exact, 10, all);
+        for (int K = 1; K <= genomes + 1; K++) {
+            vector<GenomeMatch> got, want(all.begin(), all.begin() + min<size_t>(K, all.size()));
+            matcher.findRelatedGenomes(query, fragmentMatchLength, exact, 10, K, got);
+            bool equal = got.size() == want.size();
+            for (size_t i = 0; equal && i < got.size(); i++)
+                equal = got[i].genomeName == want[i].genomeName && fabs(got[i].percentMatch - want[i].percentMatch) < 1e-9;
+            if (!equal)
+                fail(config.name + " " + stage + (exact ? " exact" : " snp") + " findRelatedGenomes top " + to_string(K) + "\n  got " + describe(got) + "\n  want" + describe(want));
+        }
+    }
+}
+
+void run(const Config& config, mt19937_64& rng)
+{
+    Synthetic::Options data;
+    data.length = 1500;
+    data.nDensity = 0.005;
+    data.mutationRate = 0.03;
+    data.seed = rng();
+    string base = Synthetic::randomSequence(data, rng);
+
+    Reference ref;
+    ref.bothStrands = config.options.bothStrands;
+    GenomeMatcher matcher(config.minSearchLength, config.options);
+    matcher.setWorkerCount(2);
+
+        // related genomes, some of them reverse complemented; half added as one batch
+    vector<Genome> batch;
+    for (int g = 0; g < 8; g++) {
+        string bases = Synthetic::mutate(base, data, rng);
+        if (g % 3 == 2)
+            bases = reverseComplement(bases);
+        string name = "genome" + to_string(g);
+        ref.genomes.push_back(make_pair(name, bases));
+        if (g < 4)
+            batch.push_back(Genome(name, bases));
+        else
+            matcher.addGenome(Genome(name, bases));
+        if (g == 3)
+            matcher.addGenomes(batch);
+    }
+
+        // fragments of the genomes on either strand, some with a SNiP, and some random ones
+    vector<string> fragments;
+    uniform_int_distribution<int> extra(0, 25);
+    for (int i = 0; i < 120; i++) {
+        const string& bases = ref.genomes[rng() % ref.genomes.size()].second;
+        int length = min<int>(config.shortest + 3 + extra(rng), static_cast<int>(bases.size()));
+        string fragment = bases.substr(rng() % (bases.size() - length + 1), length);
+        if (rng() % 2)
+            fragment = reverseComplement(fragment);
+        if (rng() % 3 == 0)
+            fragment[1 + rng() % (length - 1)] = "ACGTN"[rng() % 5];
+        if (rng() % 10 == 0)
+            fragment = Synthetic::randomSequence(Synthetic::Options{ size_t(length), 0.5, 0.0, 0.0, rng() }, rng);
+        fragments.push_back(fragment);
+    }
+    Genome query("query", reverseComplement(Synthetic::mutate(base, data, rng)).substr(0, 600));
+
+        // over 800 fragments, mostly from three of the genomes so the others fall behind
+    string text;
+    for (int g = 0; text.size() < 800 * size_t(config.shortest + 2); g++)
+        text += g % 4 == 3 ? Synthetic::mutate(base, data, rng) : ref.genomes[g % 4].second;
+    Genome longQuery("long query", text);
+
+    compare("initial", config, matcher, ref, fragments, query);
+    compareTopK("initial", config, matcher, longQuery, 8);
+
+        // drop and replace genomes; compaction may merge segments at any point from here on
+    matcher.removeGenome("genome1");
+    matcher.removeGenome("genome6");
+    string replacement = Synthetic::mutate(base, data, rng);
+    matcher.replaceGenome(Genome("genome3", replacement));
+    ref.genomes.erase(ref.genomes.begin() + 6);
+    ref.genomes.erase(ref.genomes.begin() + 1);
+    for (auto& genome : ref.genomes)
+        if (genome.first == "genome3")
+            genome.second = replacement;
+        // a replaced genome takes a new ID, so it is reported after the others
+    stable_partition(ref.genomes.begin(), ref.genomes.end(), [](const pair<string, string>& g) { return g.first != "genome3"; });
+    string added = Synthetic::mutate(base, data, rng);
+    matcher.addGenome(Genome("genome8", added));
+    ref.genomes.push_back(make_pair(string("genome8"), added));
+    compare("after remove/replace", config, matcher, ref, fragments, query);
+    compareTopK("after remove/replace", config, matcher, longQuery, 7);
+
+        // the same library, mapped from a file, with and without verifying it
+    string path = "matcher_test_" + to_string(getpid()) + ".idx";
+    if (!matcher.save(path)) {
+        fail(config.name + " save");
+        return;
+    }
+    unique_ptr<GenomeMatcher> verified(GenomeMatcher::open(path, true));
+    unique_ptr<GenomeMatcher> opened(GenomeMatcher::open(path));
+    unlink(path.c_str());
+    if (verified == nullptr || opened == nullptr) {
+        fail(config.name + " open");
+        return;
+    }
+    compare("verified", config, *verified, ref, fragments, query);
+    compare("opened", config, *opened, ref, fragments, query);
+    compareTopK("opened", config, *opened, longQuery, 7);
+}
+
+    // The sketch prefilter against the exhaustive search, on genomes spread from close to the
+    // query to distant: with every k-mer sampled it drops nothing, and with sampling it only
+    // drops genomes, never changes a percentage, and misses none well above the threshold.
+    // estimateRelatedGenomes with every k-mer sampled bounds each exact-match percentage
+void checkSketches(mt19937_64& rng)
+{
+    const int k = 11, fragmentMatchLength = 30;
+    Synthetic::Options data;
+    data.length = 6000;
+    data.nDensity = 0.002;
+    data.seed = rng();
+    string base = Synthetic::randomSequence(data, rng);
+    vector<Genome> genomes;
+    for (int g = 0; g < 12; g++) {
+        data.mutationRate = 0.004 * g;
+        genomes.push_back(Genome("genome" + to_string(g), Synthetic::mutate(base, data, rng)));
+    }
+
+        // whole fragments of base, with one in three random instead, so genome0's estimate is
+        // exactly its percentage
+    string text;
+    for (int i = 0; i < 200; i++)
+        text += i % 3 == 2 ? Synthetic::randomSequence(Synthetic::Options{ size_t(fragmentMatchLength), 0.5, 0.0, 0.0, rng() }, rng)
+                           : base.substr(rng() % (base.size() - fragmentMatchLength), fragmentMatchLength);
+    Genome query("query", text);
+
+    for (int both = 0; both < 2; both++) {
+        MatcherOptions options;
+        options.bothStrands = both;
+        GenomeMatcher exhaustive(k, options);
+        exhaustive.addGenomes(genomes);
+        for (int scale : { 1, 4, 16 }) {
+            options.sketchScale = scale;
+            GenomeMatcher sketched(k, options);
+            sketched.addGenomes(genomes);
+            string name = string(both ? "both strands" : "one strand") + " sketchScale=" + to_string(scale);
+
+            for (int exact = 0; exact < 2; exact++)
+                for (double threshold : { 20.0, 40.0, 60.0 }) {
+                    vector<GenomeMatch> got, want;
+                    exhaustive.findRelatedGenomes(query, fragmentMatchLength, exact, threshold, want);
+                    sketched.findRelatedGenomes(query, fragmentMatchLength, exact, threshold, got);
+                    string where = name + (exact ? " exact" : " snp") + " threshold " + to_string(threshold);
+                    size_t j = 0;
+                    for (const GenomeMatch& w : want) {
+                        if (j < got.size() && got[j].genomeName == w.genomeName && fabs(got[j].percentMatch - w.percentMatch) < 1e-9)
+                            j++;
+                        else if (scale == 1 || w.percentMatch >= threshold + 10)
+                            fail(where + " prefilter missed " + w.genomeName + ":" + to_string(w.percentMatch) + "\n  got " + describe(got) + "\n  want" + describe(want));
+                    }
+                    if (j < got.size())
+                        fail(where + " prefilter changed the results\n  got " + describe(got) + "\n  want" + describe(want));
+                }
+
+                // sketches are served from a saved library's file
+            string path = "matcher_test_" + to_string(getpid()) + ".idx";
+            unique_ptr<GenomeMatcher> opened(sketched.save(path) ? GenomeMatcher::open(path) : nullptr);
+            unlink(path.c_str());
+            vector<GenomeMatch> before, after;
+            sketched.estimateRelatedGenomes(query, fragmentMatchLength, 0, before);
+            if (opened == nullptr || !opened->estimateRelatedGenomes(query, fragmentMatchLength, 0, after) || describe(after) != describe(before))
+                fail(name + " estimates after save and open\n  got " + describe(after) + "\n  want" + describe(before));
+
+            if (scale != 1)
+                continue;
+            vector<GenomeMatch> estimates, exact;
+            sketched.estimateRelatedGenomes(query, fragmentMatchLength, 0, estimates);
+            exhaustive.findRelatedGenomes(query, fragmentMatchLength, true, 0, exact);
+            for (const GenomeMatch& e : exact) {
+                auto found = find_if(estimates.begin(), estimates.end(), [&](const GenomeMatch& m) { return m.genomeName == e.genomeName; });
+                if (found == estimates.end() || found->percentMatch < e.percentMatch - 1e-9)
+                    fail(name + " estimate below the exact match percentage for " + e.genomeName + "\n  estimates" + describe(estimates) + "\n  exact" + describe(exact));
+            }
+        }
+    }
+}
+
+int main()
+{
+    mt19937_64 rng(20240601);
+    vector<Config> configs;
+    for (int k : { 6, 11, 23 }) {
+        Config config;
+        config.minSearchLength = k;
+        config.shortest = k;
+        config.options.compactionThreshold = 0.1;
+
+        config.name = "ALL_KMERS k=" + to_string(k);
+        configs.push_back(config);
+
+        config.name = "ALL_KMERS both strands k=" + to_string(k);
+        config.options.bothStrands = true;
+        configs.push_back(config);
+        config.options.bothStrands = false;
+
+            // sampling only promises matches of at least k + w - 1 bases
+        config.name = "MINIMIZERS k=" + to_string(k);
+        config.options.indexMode = MatcherOptions::MINIMIZERS;
+        config.options.minimizerWindow = 4;
+        config.shortest = k + 3;
+        configs.push_back(config);
+
+        config.name = "FM_INDEX k=" + to_string(k);
+        config.options.indexMode = MatcherOptions::FM_INDEX;
+        config.shortest = k;
+        configs.push_back(config);
+    }
+    for (const Config& config : configs)
+        run(config, rng);
+    checkSketches(rng);
+
+    if (failures > 0) {
+        cerr << failures << " failures" << endl;
+        return 1;
+    }
+    cout << "all " << configs.size() << " configurations match the brute-force search" << endl;
+    return 0;
+}